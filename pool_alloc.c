@@ -1,161 +1,2492 @@
 #include "pool_alloc.h"
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Define POOL_LIBRARY to build without the test runner and main()
+#ifndef POOL_LIBRARY
 #include "pool_tests.c"
+#endif
+
+
+/* Event hook and its ctx, published together under a sequence count
+ * that is odd while pool_set_event_hook() updates them
+*/
+static struct {
+	unsigned seq;
+	pool_event_hook_t hook;
+	void* ctx;
+} g_pool_event_sink;
+
+#if POOL_TRACE_LEVEL
+// Current hook, with the ctx it was set with
+static inline pool_event_hook_t pool_event_hook(void** ctx)
+{
+	unsigned seq;
+	pool_event_hook_t hook;
+	do {
+		seq = __atomic_load_n(&g_pool_event_sink.seq, __ATOMIC_ACQUIRE);
+		hook = __atomic_load_n(&g_pool_event_sink.hook, __ATOMIC_ACQUIRE);
+		*ctx = __atomic_load_n(&g_pool_event_sink.ctx, __ATOMIC_ACQUIRE);
+	} while((seq & 1) || (seq != __atomic_load_n(&g_pool_event_sink.seq, __ATOMIC_RELAXED)));
+	return hook;
+}
+
+#define POOL_TRACE(level, event_type, pool, event_ptr, event_size) \
+	do { \
+		if(POOL_TRACE_LEVEL >= (level)) { \
+			void* event_ctx; \
+			pool_event_hook_t event_hook = pool_event_hook(&event_ctx); \
+			if(event_hook) { \
+				pool_event_t event = {(event_type), (pool), (event_size), (event_ptr)}; \
+				event_hook(&event, event_ctx); \
+			} \
+		} \
+	} while(0)
+#else
+#define POOL_TRACE(level, event_type, pool, event_ptr, event_size) ((void)0)
+#endif
+
+#if POOL_THREAD_SAFE
+#define POOL_LOCK(pool)		pthread_mutex_lock(&(pool)->lock)
+#define POOL_UNLOCK(pool)	pthread_mutex_unlock(&(pool)->lock)
+
+/* Thread Cache
+ *
+ * Each magazine is a LIFO stack of heap indices of free blocks from one
+ * pool. stocked has bit i set while magazines[i] is non-empty, mirroring
+ * pool_available for the shared pools.
+*/
+typedef struct {
+	uint16_t count;
+	pool_link_t blocks[POOL_TCACHE_SIZE];
+} pool_magazine_t;
+
+typedef struct {
+	pool_allocator_t* owner;
+	uint32_t init_generation;
+	uint32_t stocked;
+	pool_magazine_t magazines[MAX_POOLS];
+
+	/* Usage counts not yet added to the owner, see pool_tcache_count().
+	 * pending_peaks[i] is the most pending allocations were ahead of
+	 * pending frees at once.
+	 */
+	uint16_t pending_allocs[MAX_POOLS];
+	uint16_t pending_frees[MAX_POOLS];
+	uint16_t pending_peaks[MAX_POOLS];
+} pool_tcache_t;
+
+/* A thread caches blocks for up to POOL_TCACHE_INSTANCES allocators
+ * at a time, evicting round-robin beyond that.
+*/
+static _Thread_local pool_tcache_t t_pool_tcaches[POOL_TCACHE_INSTANCES];
+static _Thread_local size_t t_pool_tcache_evict;
+static _Thread_local bool t_pool_tcache_registered;
+static pthread_key_t g_pool_tcache_key;
+static inline void pool_tcache_set_owner(pool_tcache_t* tcache, pool_allocator_t* owner);
+static pthread_once_t g_pool_tcache_once = PTHREAD_ONCE_INIT;
+
+pool_controller_t pool_controller = { .lock = PTHREAD_MUTEX_INITIALIZER };
+#else
+#define POOL_LOCK(pool)		((void)0)
+#define POOL_UNLOCK(pool)	((void)0)
+
+pool_controller_t pool_controller;
+#endif
+
+_Alignas(POOL_PAGE_SIZE) uint8_t g_pool_heap[HEAP_SIZE];
+
+// Source of pool_controller_t::init_generation, unique across allocators
+static uint32_t g_pool_init_generation;
 
 
+void pool_set_event_hook(pool_event_hook_t hook, void* ctx) {
+	unsigned seq = __atomic_load_n(&g_pool_event_sink.seq, __ATOMIC_RELAXED);
+	__atomic_store_n(&g_pool_event_sink.seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&g_pool_event_sink.hook, hook, __ATOMIC_RELEASE);
+	__atomic_store_n(&g_pool_event_sink.ctx, ctx, __ATOMIC_RELEASE);
+	__atomic_store_n(&g_pool_event_sink.seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void pool_trace_stdio(const pool_event_t* event, void* ctx) {
+	(void)ctx;
+	switch(event->type) {
+		case POOL_EVENT_MALLOC:
+			printf("pool %u malloc: %p\n", event->pool_idx, event->ptr);
+			break;
+		case POOL_EVENT_FREE:
+			printf("pool %u free: %p\n", event->pool_idx, event->ptr);
+			break;
+		case POOL_EVENT_POOL_FULL:
+			printf("Filled last block in pool %u\n", event->pool_idx);
+			break;
+		case POOL_EVENT_MALLOC_FAILED:
+			printf("Not enough space in pools for block size %zu\n", event->size);
+			break;
+		case POOL_EVENT_SLAB_ACQUIRED:
+			printf("pool %u slab acquired: %zu bytes at %p\n", event->pool_idx, event->size, event->ptr);
+			break;
+		case POOL_EVENT_SLAB_RELEASED:
+			printf("pool %u slab released: %zu bytes at %p\n", event->pool_idx, event->size, event->ptr);
+			break;
+	}
+}
+
 void print_heap_range(size_t idx, size_t padding) {
 	for(size_t i = idx - padding; i < idx + padding; i++) {
 			printf("%zu: %d\n", i, g_pool_heap[i]);
 		}
 }
 
-bool verify_heap_inputs(const size_t* block_sizes, size_t block_size_count) {
-	bool valid_inputs = true;
+/* Index of the pool containing heap index idx
+*/
+static inline size_t pool_index_of(const pool_allocator_t* pool, size_t idx) {
+	switch(pool->owner_lookup) {
+		case POOL_OWNER_SHIFT:
+			return idx >> pool->pool_size_shift;
+		case POOL_OWNER_DIVIDE:
+			return idx / pool->pool_size;
+		default:
+			return pool->owner_map[idx >> pool->owner_map_shift];
+	}
+}
 
-	if(!block_size_count || (block_size_count > MAX_POOLS)) {
-		valid_inputs = false; 
+/* Pool Layout
+ *
+ * Heap indices of the first and last block of every pool, as planned
+ * from a configuration by pool_plan_layout().
+*/
+typedef struct {
+	size_t begins[MAX_POOLS];
+	size_t ends[MAX_POOLS];
+	bool uniform;
+	size_t pool_size;				// Of every pool, when uniform
+	uint8_t owner_map_shift;
+	size_t bitmap_begin;			// Heap index of the bitmaps, see pool_plan_heap()
+	size_t bitmap_offsets[MAX_POOLS];
+} pool_layout_t;
+
+/* Smallest page size (as a shift) keeping the owner map of a heap_size
+ * bytes heap within POOL_OWNER_MAP_SIZE, and above page_mask.
+*/
+static size_t pool_owner_page_shift(size_t heap_size, size_t page_mask)
+{
+	size_t page_shift = 0;
+	while((((heap_size - 1) >> page_shift) >= POOL_OWNER_MAP_SIZE) ||
+	      (((size_t)1 << page_shift) <= page_mask)) {
+		page_shift++;
 	}
-	else {
-		// Check for block sizes exceeding pool size
-		size_t pool_sizes = HEAP_SIZE / block_size_count; 
+	return page_shift;
+}
+
+/* Plan the pools of a heap_size bytes heap.
+ *
+ * Returns true if the configuration is valid and fits in the heap.
+*/
+static bool pool_plan_layout(size_t heap_size, const pool_config_t* config, pool_layout_t* layout)
+{
+	const size_t* block_sizes = config->block_sizes;
+	size_t block_size_count = config->block_size_count;
+
+	if(!block_sizes || !block_size_count || (block_size_count > MAX_POOLS) ||
+	   (heap_size > POOL_MAX_HEAP_SIZE) || (config->pool_weights && config->pool_block_counts) ||
+	   (config->page_size & (config->page_size - 1))) {
+		return false;
+	}
+	// Pools start on cache line boundaries at least, see pool_aligned_malloc()
+	size_t page_mask = ((config->page_size > POOL_CACHE_LINE) ? config->page_size : POOL_CACHE_LINE) - 1;
+
+	// Blocks must be ascending class sizes able to hold a free list link, if any
+	for(size_t i = 0; i < block_size_count; i++) {
+		if((!config->bitmap && (block_sizes[i] < sizeof(pool_link_t))) ||
+		   (block_sizes[i] != size_class_size(size_class_of(block_sizes[i]))) ||
+		   (i && (block_sizes[i] <= block_sizes[i-1]))) {
+			return false;
+		}
+	}
+
+	layout->uniform = !config->pool_weights && !config->pool_block_counts;
+	if(layout->uniform) {
+		// Distribute the heap evenly between pools
+		size_t pool_size = (heap_size / block_size_count) & ~page_mask; 
+		layout->pool_size = pool_size;
 		for(size_t i = 0; i < block_size_count; i++) {
-			if(block_sizes[i] > pool_sizes) {
-				valid_inputs = false; 
+			if(block_sizes[i] > pool_size) {
+				return false;
 			}
+			layout->begins[i] = i * pool_size;
+			layout->ends[i] = (i+1) * pool_size - block_sizes[i];
+		}
+		return true;
+	}
+
+	size_t page_shift = pool_owner_page_shift(heap_size, page_mask);
+	size_t page_size = (size_t)1 << page_shift;
+	layout->owner_map_shift = page_shift;
+
+	size_t total_weight = 0;
+	for(size_t i = 0; config->pool_weights && (i < block_size_count); i++) {
+		if(__builtin_add_overflow(total_weight, config->pool_weights[i], &total_weight)) {
+			return false;
+		}
+	}
+	if(config->pool_weights && !total_weight) {
+		return false;
+	}
+
+	size_t pool_begin = 0;
+	for(size_t i = 0; i < block_size_count; i++) {
+		size_t pool_bytes;
+		if(config->pool_weights) {
+			// Share of the heap, trimmed so the next pool starts on a page
+			pool_bytes = (unsigned __int128)heap_size * config->pool_weights[i] / total_weight;
+			pool_bytes &= ~(page_size - 1);
 		}
+		else if(__builtin_mul_overflow(config->pool_block_counts[i], block_sizes[i], &pool_bytes) ||
+		        (pool_bytes > heap_size)) {
+			return false;
+		}
+
+		size_t block_count = pool_bytes / block_sizes[i];
+		if(!block_count || (pool_begin > heap_size) || (pool_bytes > heap_size - pool_begin)) {
+			return false;
+		}
+		layout->begins[i] = pool_begin;
+		layout->ends[i] = pool_begin + (block_count - 1) * block_sizes[i];
+
+		// Next pool starts on the first page after this one
+		pool_begin += (pool_bytes + page_size - 1) & ~(page_size - 1);
 	}
-	return valid_inputs; 
+	return true;
 }
 
-bool pool_init(const size_t* block_sizes, size_t block_size_count)
+// Bitmap words of pool i of a layout
+static inline size_t pool_bitmap_words(const pool_layout_t* layout, const size_t* block_sizes, size_t i)
+{
+	size_t blocks = (layout->ends[i] - layout->begins[i]) / block_sizes[i] + 1;
+	return (blocks + 63) / 64;
+}
+
+/* Plan the pools of a heap_size bytes heap, followed by their bitmaps
+ * when the configuration tracks blocks with bitmaps.
+ *
+ * The pools are planned over the whole heap first to bound the size of
+ * the bitmaps, then over what is left in front of them.
+*/
+static bool pool_plan_heap(size_t heap_size, const pool_config_t* config, pool_layout_t* layout)
+{
+	if(!pool_plan_layout(heap_size, config, layout)) {
+		return false;
+	}
+	layout->bitmap_begin = heap_size;
+	if(!config->bitmap) {
+		return true;
+	}
+
+	size_t words = 0;
+	for(size_t i = 0; i < config->block_size_count; i++) {
+		words += pool_bitmap_words(layout, config->block_sizes, i);
+	}
+	if(words * sizeof(uint64_t) >= heap_size) {
+		return false;
+	}
+
+	size_t bitmap_begin = (heap_size - words * sizeof(uint64_t)) & ~(size_t)(POOL_CACHE_LINE - 1);
+	if(!bitmap_begin || !pool_plan_layout(bitmap_begin, config, layout)) {
+		return false;
+	}
+	layout->bitmap_begin = bitmap_begin;
+	for(size_t i = 0, offset = 0; i < config->block_size_count; i++) {
+		layout->bitmap_offsets[i] = offset;
+		offset += pool_bitmap_words(layout, config->block_sizes, i);
+	}
+	return true;
+}
+
+/* Returns true if the growth settings of a configuration are valid
+ * for a heap_size bytes heap, or growth is disabled.
+*/
+static bool pool_verify_growth(size_t heap_size, const pool_config_t* config)
+{
+	if(config->rebalance > POOL_REBALANCE_SPARE) {
+		return false;
+	}
+	if(config->reserve_size) {
+		if(config->slab_acquire || !config->slab_size || (config->slab_size % POOL_CACHE_LINE) ||
+		   (config->reserve_size % config->slab_size) ||
+		   (config->reserve_size / config->slab_size > POOL_MAX_SLABS) || (config->reserve_size >= heap_size)) {
+			return false;
+		}
+	}
+	else if(!config->slab_acquire) {
+		return true;
+	}
+	else if(!config->slab_release) {
+		return false;
+	}
+	if(POOL_LOCK_FREE || (config->slab_size > POOL_MAX_HEAP_SIZE)) {
+		return false;
+	}
+	for(size_t i = 0; i < config->block_size_count; i++) {
+		if(config->block_sizes[i] > config->slab_size) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Heap index of the slab reserve of a heap_size bytes heap, where the
+ * pools end. heap_size without a reserve.
+*/
+static size_t pool_reserve_begin(size_t heap_size, const pool_config_t* config)
 {
-	if(!verify_heap_inputs(block_sizes, block_size_count)) {
+	if(!config->reserve_size) {
+		return heap_size;
+	}
+	return (heap_size - config->reserve_size) & ~(size_t)(POOL_CACHE_LINE - 1);
+}
+
+bool verify_pool_config(size_t heap_size, const pool_config_t* config) {
+	pool_layout_t layout;
+	if(config->bitmap && (POOL_LOCK_FREE || config->slab_acquire || config->reserve_size)) {
 		return false;
 	}
+	return (config->spill <= POOL_SPILL_NONE) && pool_verify_growth(heap_size, config) &&
+	       pool_plan_heap(pool_reserve_begin(heap_size, config), config, &layout);
+}
+
+bool verify_pool_inputs(size_t heap_size, const size_t* block_sizes, size_t block_size_count) {
+	pool_config_t config = {.block_sizes = block_sizes, .block_size_count = block_size_count};
+	return verify_pool_config(heap_size, &config);
+}
+
+bool verify_heap_inputs(const size_t* block_sizes, size_t block_size_count) {
+	return verify_pool_inputs(HEAP_SIZE, block_sizes, block_size_count);
+}
+
+/* Hand slab s back to the slab source
+*/
+static void pool_slab_release(pool_allocator_t* pool, size_t s)
+{
+	pool_slab_t* slab = &pool->slabs[s];
+	POOL_TRACE(2, POOL_EVENT_SLAB_RELEASED, slab->pool_idx, slab->base, pool->slab_size);
+
+	pool->slab_release(slab->base, pool->slab_size, pool->slab_ctx);
+	pool->slab_used &= ~(1u << s);
+	pool->slab_available &= ~(1u << s);
+	pool->pool_slabs[slab->pool_idx] &= ~(1u << s);
+}
+
+/* Slab source carving the reserve at the end of an allocator's heap,
+ * ctx is the allocator. Called with its lock held.
+*/
+static void* pool_slab_acquire_reserve(size_t size, void* ctx)
+{
+	pool_allocator_t* pool = ctx;
+	if(!pool->reserve_free) {
+		return NULL;
+	}
+
+	size_t s = __builtin_ctz(pool->reserve_free);
+	pool->reserve_free &= pool->reserve_free - 1;
+	return &pool->heap[pool->reserve_begin + s * size];
+}
+
+static void pool_slab_release_reserve(void* slab, size_t size, void* ctx)
+{
+	pool_allocator_t* pool = ctx;
+	size_t s = ((uint8_t*)slab - &pool->heap[pool->reserve_begin]) / size;
+	pool->reserve_free |= 1u << s;
+}
+
+static void pool_slab_release_all(pool_allocator_t* pool)
+{
+	while(pool->slab_used) {
+		pool_slab_release(pool, __builtin_ctz(pool->slab_used));
+	}
+}
+
+/* Lay out the pools of an allocator over heap[0..heap_size).
+ *
+ * The configuration must have been checked by verify_pool_config().
+*/
+static void pool_setup(pool_allocator_t* pool, uint8_t* heap, size_t heap_size,
+                       const pool_config_t* config)
+{
+	const size_t* block_sizes = config->block_sizes;
+	size_t block_size_count = config->block_size_count;
+	pool_link_t pool_begin_idx; 
+	pool_link_t pool_end_idx;
+
+	size_t reserve_begin = pool_reserve_begin(heap_size, config);
+	pool_layout_t layout;
+	pool_plan_heap(reserve_begin, config, &layout);
 
-	uint16_t pool_begin_idx; 
-	uint16_t pool_end_idx;
+	POOL_LOCK(pool);
+
+	// Slabs of a previous initialization are released, like its blocks
+	pool_slab_release_all(pool);
 
 	// Initialize pool controller
-	pool_controller.num_pools = block_size_count; 
+	pool->init_generation = __atomic_add_fetch(&g_pool_init_generation, 1, __ATOMIC_RELAXED);
+	pool->slab_acquire = config->slab_acquire;
+	pool->slab_release = config->slab_release;
+	pool->slab_ctx = config->slab_ctx;
+	pool->slab_size = config->slab_size;
+	pool->rebalance = config->rebalance;
+	pool->reserve_begin = reserve_begin;
+	pool->bitmap = config->bitmap;
+	pool->bitmap_begin = layout.bitmap_begin;
+	pool->double_free_count = 0;
+	pool->reserve_free = 0;
+	if(config->reserve_size) {
+		// Growth slabs come from the end of the heap
+		pool->slab_acquire = pool_slab_acquire_reserve;
+		pool->slab_release = pool_slab_release_reserve;
+		pool->slab_ctx = pool;
+		pool->reserve_free = (uint32_t)((1ull << (config->reserve_size / config->slab_size)) - 1);
+	}
+	pool->heap = heap;
+	pool->heap_size = heap_size;
+	pool->num_pools = block_size_count; 
+	if(layout.uniform) {
+		pool->pool_size = layout.pool_size;
+		pool->pool_size_shift = __builtin_ctzll(pool->pool_size);
+		pool->owner_lookup = (pool->pool_size & (pool->pool_size - 1)) ?
+		                     POOL_OWNER_DIVIDE : POOL_OWNER_SHIFT;
+	}
+	else {
+		pool->pool_size = 0;
+		pool->owner_map_shift = layout.owner_map_shift;
+		pool->owner_lookup = POOL_OWNER_MAP;
+	}
+	pool->unfit_count = 0;
 	for(size_t i = 0; i < block_size_count; i++) {
 		// Save block sizes to global state for use in pool_alloc() and pool_free()
-		pool_controller.block_sizes[i] = block_sizes[i];
+		pool->block_sizes[i] = block_sizes[i];
+
+		pool_begin_idx = layout.begins[i]; 
+		pool_end_idx = layout.ends[i];
+		pool->pool_begin_indices[i] = pool_begin_idx;
+		pool->pool_end_indices[i] = pool_end_idx;
+		pool->spill_counts[i] = 0;
+		pool->spill_bytes[i] = 0;
+		pool->alloc_counts[i] = 0;
+		pool->free_counts[i] = 0;
+		pool->high_water[i] = 0;
+		pool->fail_counts[i] = 0;
 
-		// Distribute the heap evenly between blocks
-		pool_begin_idx = i * (HEAP_SIZE / block_size_count); 
-		pool_end_idx = (i+1) * (HEAP_SIZE / block_size_count) - block_sizes[i];
-		pool_controller.pool_begin_indices[i] = pool_begin_idx;
-		pool_controller.pool_end_indices[i] = pool_end_idx;
+		/* Initialize pool allocators and set pools to empty by default.
+		 * Lazy pools start with an empty free list and carve blocks from
+		 * the bump index, eager pools have every block linked below.
+		 */
+		pool->pool_full[i] = false; 
+		if(config->bitmap) {
+			// Every block free, the bits past the last one set
+			size_t blocks = (pool_end_idx - pool_begin_idx) / block_sizes[i] + 1;
+			size_t words = pool_bitmap_words(&layout, block_sizes, i);
+			uint64_t* bitmap = (uint64_t*)&heap[layout.bitmap_begin] + layout.bitmap_offsets[i];
+			memset(bitmap, 0, words * sizeof(uint64_t));
+			if(blocks % 64) {
+				bitmap[words - 1] = ~0ull << (blocks % 64);
+			}
+			pool->bitmap_offsets[i] = layout.bitmap_offsets[i];
+			pool->bitmap_hints[i] = 0;
+			pool->bitmap_free[i] = blocks;
+		}
+		if(config->lazy || config->bitmap) {
+			pool->pool_allocators[i] = POOL_NULL_LINK;
+			pool->pool_bumps[i] = pool_begin_idx;
+		}
+		else {
+			pool->pool_allocators[i] = pool_begin_idx;
+			pool->pool_bumps[i] = (size_t)pool_end_idx + block_sizes[i];
+		}
+#if POOL_LOCK_FREE
+		atomic_init(&pool->pool_heads[i], POOL_HEAD(pool->pool_allocators[i], 0));
+#endif
+	}
+	pool->pool_available = (1u << block_size_count) - 1;
 
-		// Initialize pool allocators and set pools to empty by default
-		pool_controller.pool_full[i] = false; 
-		pool_controller.pool_allocators[i] = pool_begin_idx;
+	// Record the owner of every page spanned by a non-uniform pool
+	for(size_t i = 0; !layout.uniform && (i < block_size_count); i++) {
+		size_t first_page = layout.begins[i] >> layout.owner_map_shift;
+		size_t last_page = (layout.ends[i] + block_sizes[i] - 1) >> layout.owner_map_shift;
+		for(size_t page = first_page; page <= last_page; page++) {
+			pool->owner_map[page] = i;
+		}
 	}
 
-	uint16_t block_count = 1; 
-	uint32_t pool_begin, pool_end, next_block;
-	// Use pool controller to populate heap map
+	/* Precompute which pools can serve each size class. Block sizes are
+	 * class sizes, so a block fits n bytes iff it fits the largest size
+	 * of n's class. The spill policy then drops the pools a size class
+	 * may not spill to.
+	 */
+	pool->spill = config->spill;
+	for(size_t k = 0; k < SIZE_CLASS_COUNT; k++) {
+		uint32_t fitting_pools = 0;
+		for(size_t i = 0; i < block_size_count; i++) {
+			if(block_sizes[i] >= size_class_size(k)) {
+				fitting_pools |= 1u << i;
+			}
+		}
+
+		uint32_t spill_pools = fitting_pools & (fitting_pools - 1);
+		if(config->spill == POOL_SPILL_NEXT) {
+			spill_pools &= -spill_pools;
+		}
+		else if(config->spill == POOL_SPILL_NONE) {
+			spill_pools = 0;
+		}
+		pool->size_class_pools[k] = (fitting_pools & -fitting_pools) | spill_pools;
+	}
+
+	/* Precompute which pools can serve each alignment. Every block of a
+	 * pool is aligned to the largest power of 2 dividing both the address
+	 * of its first block and the block size.
+	 */
+	for(size_t k = 0; k < ALIGN_CLASS_COUNT; k++) {
+		pool->align_pools[k] = 0;
+	}
 	for(size_t i = 0; i < block_size_count; i++) {
-		pool_begin = pool_controller.pool_begin_indices[i];
-		pool_end   = pool_controller.pool_end_indices[i]; 
+		uintptr_t pool_addr = (uintptr_t)&heap[pool->pool_begin_indices[i]];
+		size_t block_align = (pool_addr | block_sizes[i]) & -(pool_addr | block_sizes[i]);
+		for(size_t k = 0; ((size_t)1 << k) <= block_align; k++) {
+			pool->align_pools[k] |= 1u << i;
+		}
+	}
+
+	size_t block_count = 1; 
+	size_t pool_begin, pool_end, next_block;
+	// Use pool controller to populate heap map
+	for(size_t i = 0; !config->lazy && !config->bitmap && (i < block_size_count); i++) {
+		pool_begin = pool->pool_begin_indices[i];
+		pool_end   = pool->pool_end_indices[i]; 
 
 		for(size_t j = pool_begin; j < pool_end + 1; j += block_sizes[i]) {
 			next_block = pool_begin + block_sizes[i] * block_count; 
 			
 			if(next_block <= pool_end) {
-				// Heap must store 16-bit addresses in 2 8-bit elements
-				g_pool_heap[j]   = next_block & 0xFF; // Lower byte
-				g_pool_heap[j+1] = next_block >> 8;   // Upper byte
+				pool_link_write(heap, j, next_block);
 			}
 			else {
-				/* Last block in a pool points back to its pool_begin
-				 * index to indicate the end of the pool. 
+				/* Last block in a pool holds the null link to indicate
+				 * the end of the pool. A link back to pool_begin would be
+				 * ambiguous once the first block is freed into the list.
 				 */
-				g_pool_heap[j] = pool_begin & 0xFF;   // Lower byte 
-				g_pool_heap[j+1]   = pool_begin >> 8; // Upper byte
+				pool_link_write(heap, j, POOL_NULL_LINK);
 			}
 			block_count++; 
 		}
 		block_count = 1;
 	}
+
+	POOL_UNLOCK(pool);
+}
+
+bool pool_init_ex(const pool_config_t* config)
+{
+	if(!verify_pool_config(HEAP_SIZE, config) || (config->page_size > POOL_PAGE_SIZE)) {
+		return false;
+	}
+
+	pool_setup(&pool_controller, g_pool_heap, HEAP_SIZE, config);
 	return true; 
 }
 
-void* pool_malloc(size_t n)
+bool pool_init(const size_t* block_sizes, size_t block_size_count)
 {
-	void* store_addr = NULL; 
-	uint16_t store_idx; 
+	pool_config_t config = {.block_sizes = block_sizes, .block_size_count = block_size_count};
+	return pool_init_ex(&config);
+}
 
-	// Find first pool index that can store object of size n
-	size_t pool_idx = 0;
-	for(; pool_idx < pool_controller.num_pools; pool_idx++) {
-		// Possible storage found
-		if(n <= pool_controller.block_sizes[pool_idx]) {
-			// Sufficient space in current pool
-			if(!pool_controller.pool_full[pool_idx]) {
-				store_idx = pool_controller.pool_allocators[pool_idx];
-				store_addr = &g_pool_heap[store_idx]; 
-				break; 
-			}
-		}
-	}	
+pool_allocator_t* pool_create_ex(void* buffer, size_t size, const pool_config_t* config)
+{
+	// The allocator is placed at the start of the buffer, the heap follows it
+	// on the next page boundary if pools are page aligned
+	uintptr_t page_mask = config->page_size ? config->page_size - 1 : 0;
+	uintptr_t buffer_begin = (uintptr_t)buffer;
+	uintptr_t buffer_end = buffer_begin + size;
+	uintptr_t pool_addr = (buffer_begin + _Alignof(pool_allocator_t) - 1) &
+	                      ~(uintptr_t)(_Alignof(pool_allocator_t) - 1);
+	uintptr_t heap_addr = (pool_addr + sizeof(pool_allocator_t) + page_mask) & ~page_mask;
 
-	// Update pool_allocators and set pool full if necessary
-	if(store_addr) {
-		// Reconstruct index for next block based on two 8-bit values
-		uint16_t next_block_idx = (g_pool_heap[store_idx+1] << 8) | g_pool_heap[store_idx];
+	if(!buffer || (buffer_end < buffer_begin) || (heap_addr <= pool_addr) ||
+	   (heap_addr >= buffer_end)) {
+		return NULL;
+	}
+	if(!verify_pool_config(buffer_end - heap_addr, config)) {
+		return NULL;
+	}
 
-		// Check for pool full indication (i.e. loopback to first block in pool)
-		if(next_block_idx == pool_controller.pool_begin_indices[pool_idx]) {
-			
-			printf("Filled last block in pool %zu\n", pool_idx);
-			
-			pool_controller.pool_allocators[pool_idx] = next_block_idx;
-			pool_controller.pool_full[pool_idx] = true; 
+	pool_allocator_t* pool = (pool_allocator_t*)pool_addr;
+	memset(pool, 0, sizeof(*pool));
+#if POOL_THREAD_SAFE
+	pthread_mutex_init(&pool->lock, NULL);
+#endif
+
+	pool_setup(pool, (uint8_t*)heap_addr, buffer_end - heap_addr, config);
+	return pool;
+}
+
+pool_allocator_t* pool_create(void* buffer, size_t size,
+                              const size_t* block_sizes, size_t block_size_count)
+{
+	pool_config_t config = {.block_sizes = block_sizes, .block_size_count = block_size_count};
+	return pool_create_ex(buffer, size, &config);
+}
+
+// MPOL_BIND of <numaif.h>, which comes with libnuma rather than libc
+#define POOL_MPOL_BIND		2
+
+static long pool_mbind(void* addr, size_t size, size_t node)
+{
+	unsigned long nodemask[256 / (8 * sizeof(unsigned long))] = {0};
+	nodemask[node / (8 * sizeof(unsigned long))] = 1ul << (node % (8 * sizeof(unsigned long)));
+	return syscall(SYS_mbind, addr, size, POOL_MPOL_BIND, nodemask, (unsigned long)256, 0u);
+}
+
+pool_allocator_t* pool_map(size_t size, const pool_config_t* config, unsigned flags)
+{
+	// The allocator gets the first page(s) of the mapping, the heap the rest
+	pool_config_t mapped_config = *config;
+	if(!mapped_config.page_size) {
+		mapped_config.page_size = sysconf(_SC_PAGESIZE);
+	}
+	size_t page_mask = mapped_config.page_size - 1;
+	size_t buffer_size = ((sizeof(pool_allocator_t) + page_mask) & ~page_mask) + size;
+	if(buffer_size < size) {
+		return NULL;
+	}
+
+	size_t mapping_size = buffer_size;
+	void* mapping = MAP_FAILED;
+	if(flags & POOL_MAP_HUGETLB) {
+		// Explicit huge pages, if the system has any reserved
+		mapping_size = (buffer_size + POOL_HUGE_PAGE_SIZE - 1) & ~(POOL_HUGE_PAGE_SIZE - 1);
+		mapping = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE,
+		               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	}
+	if(mapping == MAP_FAILED) {
+		mapping_size = buffer_size;
+		mapping = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE,
+		               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(mapping == MAP_FAILED) {
+			return NULL;
 		}
-		else {
-			pool_controller.pool_allocators[pool_idx] = next_block_idx;
+		if(flags & POOL_MAP_HUGEPAGE) {
+			// Transparent huge pages are best effort
+			madvise(mapping, mapping_size, MADV_HUGEPAGE);
+		}
+	}
+	if(flags & POOL_MAP_BIND) {
+		// Best effort as well, the kernel may lack NUMA support or the node
+		pool_mbind(mapping, mapping_size, (flags >> 8) & 0xffu);
+	}
+
+	pool_allocator_t* pool = pool_create_ex(mapping, buffer_size, &mapped_config);
+	if(!pool) {
+		munmap(mapping, mapping_size);
+		return NULL;
+	}
+	pool->mapping = mapping;
+	pool->mapping_size = mapping_size;
+	return pool;
+}
+
+void pool_destroy(pool_allocator_t* pool)
+{
+	if(pool) {
+		pool_slab_release_all(pool);
+	}
+#if POOL_THREAD_SAFE
+	if(pool) {
+		// Caches still bound to pool must not flush into it, and the
+		// calling thread's caches forget it altogether
+		pool->init_generation = __atomic_add_fetch(&g_pool_init_generation, 1, __ATOMIC_RELAXED);
+		for(size_t i = 0; i < POOL_TCACHE_INSTANCES; i++) {
+			if(t_pool_tcaches[i].owner == pool) {
+				pool_tcache_set_owner(&t_pool_tcaches[i], NULL);
+			}
 		}
+#if POOL_DEBUG
+		// Every other thread must have flushed or exited
+		assert(!__atomic_load_n(&pool->bound_tcaches, __ATOMIC_RELAXED));
+#endif
+		pthread_mutex_destroy(&pool->lock);
+	}
+#endif
+	if(pool && pool->mapping) {
+		// The allocator itself lives in the mapping
+		munmap(pool->mapping, pool->mapping_size);
+	}
+}
+
+// Bitmap words of pool_idx
+static inline uint64_t* pool_bitmap(const pool_allocator_t* pool, size_t pool_idx)
+{
+	return (uint64_t*)&pool->heap[pool->bitmap_begin] + pool->bitmap_offsets[pool_idx];
+}
+
+/* pool_pop() for bitmap pools: the lowest free block, found with a
+ * count of trailing zeros from the first word that may have one.
+*/
+static inline pool_link_t pool_bitmap_pop(pool_allocator_t* pool, size_t pool_idx)
+{
+	uint64_t* bitmap = pool_bitmap(pool, pool_idx);
+	size_t word = pool->bitmap_hints[pool_idx];
+	while(!~bitmap[word]) {
+		word++;
+	}
+	size_t bit = __builtin_ctzll(~bitmap[word]);
+	bitmap[word] |= 1ull << bit;
+	pool->bitmap_hints[pool_idx] = word;
+
+	pool_link_t block_idx = pool->pool_begin_indices[pool_idx] + (word * 64 + bit) * pool->block_sizes[pool_idx];
+	if(block_idx >= pool->pool_bumps[pool_idx]) {
+		// Blocks are used in address order, so the bump index still marks
+		// the first never-used block
+		pool->pool_bumps[pool_idx] = block_idx + pool->block_sizes[pool_idx];
+	}
+	if(!--pool->bitmap_free[pool_idx]) {
+		POOL_TRACE(2, POOL_EVENT_POOL_FULL, pool_idx, &pool->heap[block_idx],
+		           pool->block_sizes[pool_idx]);
+		pool->pool_full[pool_idx] = true; 
+		pool->pool_available &= ~(1u << pool_idx);
+	}
+	return block_idx;
+}
+
+/* pool_push() for bitmap pools, ignoring blocks already free
+*/
+static inline void pool_bitmap_push(pool_allocator_t* pool, size_t pool_idx, pool_link_t block_idx)
+{
+	size_t block = (block_idx - pool->pool_begin_indices[pool_idx]) / pool->block_sizes[pool_idx];
+	uint64_t* word = &pool_bitmap(pool, pool_idx)[block / 64];
+	uint64_t mask = 1ull << (block % 64);
+	if(!(*word & mask)) {
+		pool->double_free_count++;
+		return;
+	}
+
+	*word &= ~mask;
+	if(block / 64 < pool->bitmap_hints[pool_idx]) {
+		pool->bitmap_hints[pool_idx] = block / 64;
+	}
+	if(!pool->bitmap_free[pool_idx]++) {
+		pool->pool_full[pool_idx] = false; 
+		pool->pool_available |= 1u << pool_idx;
+	}
+}
+
+/* Take the first free block of pool_idx, which must not be full.
+ *
+ * Returns the heap index of the block. Caller holds the pool lock.
+*/
+static inline pool_link_t pool_pop(pool_allocator_t* pool, size_t pool_idx)
+{
+	if(pool->bitmap) {
+		return pool_bitmap_pop(pool, pool_idx);
+	}
 
-		printf("pool %zu malloc: %p\n", pool_idx, store_addr);
+	pool_link_t block_idx = pool->pool_allocators[pool_idx];
+	pool_link_t next_block_idx;
+
+	if(block_idx != POOL_NULL_LINK) {
+		next_block_idx = pool_link_read(pool->heap, block_idx);
 	}
 	else {
-		printf("Not enough space in pools for block size %zu\n", n); 
+		// Free list is empty, carve the next never-used block
+		block_idx = pool->pool_bumps[pool_idx];
+		pool->pool_bumps[pool_idx] += pool->block_sizes[pool_idx];
+		next_block_idx = POOL_NULL_LINK;
 	}
 
-	return store_addr; 
+	// Check for pool full indication (i.e. end of the free list and no
+	// never-used blocks left)
+	if((next_block_idx == POOL_NULL_LINK) &&
+	   (pool->pool_bumps[pool_idx] > pool->pool_end_indices[pool_idx])) {
+		POOL_TRACE(2, POOL_EVENT_POOL_FULL, pool_idx, &pool->heap[block_idx],
+		           pool->block_sizes[pool_idx]);
+
+		// A full pool's allocator rests on its first block
+		pool->pool_allocators[pool_idx] = pool->pool_begin_indices[pool_idx];
+		pool->pool_full[pool_idx] = true; 
+		pool->pool_available &= ~(1u << pool_idx);
+	}
+	else {
+		pool->pool_allocators[pool_idx] = next_block_idx;
+	}
+
+	return block_idx;
 }
 
-void pool_free(void* ptr)
+/* Return the block at heap index block_idx to pool_idx.
+ *
+ * Caller holds the pool lock.
+*/
+static inline void pool_push(pool_allocator_t* pool, size_t pool_idx, pool_link_t block_idx)
 {
-	if(ptr) {
-		// Find which pool the memory belongs to
-		uint16_t pool_idx = 0, next_pool_begin_idx;
-		for(; pool_idx < pool_controller.num_pools - 1; pool_idx++) {
+	if(pool->bitmap) {
+		pool_bitmap_push(pool, pool_idx, block_idx);
+		return;
+	}
 
-			// Pool is found when ptr address < next pool's begin address
-			next_pool_begin_idx = pool_controller.pool_begin_indices[pool_idx + 1];
-			if(ptr < (void*)&g_pool_heap[next_pool_begin_idx]) {
-				break;
-			}
+	// The freed block now points to the allocation pointer, or ends the
+	// free list if the pool was full
+	pool_link_t pa = pool->pool_allocators[pool_idx];
+	if(pool->pool_full[pool_idx]) {
+		pool->pool_full[pool_idx] = false; 
+		pool->pool_available |= 1u << pool_idx;
+		pa = POOL_NULL_LINK;
+	}
+	pool_link_write(pool->heap, block_idx, pa);
+
+	// The allocation pointer now points to the freed block
+	pool->pool_allocators[pool_idx] = block_idx; 
+}
+
+#if !POOL_LOCK_FREE
+/* Take a free block of pool_idx from its growth slabs, acquiring a new
+ * slab if they are all full.
+ *
+ * Returns NULL if no slab could be acquired. Caller holds the pool lock.
+*/
+static void* pool_slab_pop(pool_allocator_t* pool, size_t pool_idx)
+{
+	size_t block_size = pool->block_sizes[pool_idx];
+	uint32_t slabs = pool->slab_available & pool->pool_slabs[pool_idx];
+	size_t s;
+
+	if(slabs) {
+		s = __builtin_ctz(slabs);
+	}
+	else {
+		uint32_t unused = ~pool->slab_used & ((1u << POOL_MAX_SLABS) - 1);
+		uint8_t* base = unused ? pool->slab_acquire(pool->slab_size, pool->slab_ctx) : NULL;
+		if(!base) {
+			return NULL;
 		}
 
-		// Toggle pool full flag if necessary
-		if(pool_controller.pool_full[pool_idx]) {
-			pool_controller.pool_full[pool_idx] = false; 
+		s = __builtin_ctz(unused);
+		pool->slabs[s] = (pool_slab_t){.base = base, .pool_idx = pool_idx, .free = POOL_NULL_LINK};
+		pool->slab_used |= 1u << s;
+		pool->slab_available |= 1u << s;
+		pool->pool_slabs[pool_idx] |= 1u << s;
+		POOL_TRACE(2, POOL_EVENT_SLAB_ACQUIRED, pool_idx, base, pool->slab_size);
+	}
+
+	// Same order as pool_pop(): free list first, then never-used blocks
+	pool_slab_t* slab = &pool->slabs[s];
+	size_t block_idx = slab->free;
+	if(slab->free != POOL_NULL_LINK) {
+		slab->free = pool_link_read(slab->base, block_idx);
+	}
+	else {
+		block_idx = slab->bump;
+		slab->bump += block_size;
+	}
+	slab->used++;
+
+	if((slab->free == POOL_NULL_LINK) && (slab->bump + block_size > pool->slab_size)) {
+		pool->slab_available &= ~(1u << s);
+	}
+	return &slab->base[block_idx];
+}
+#endif
+
+/* Index of the growth slab holding ptr, or -1 if ptr is in no slab.
+ * Caller holds the pool lock.
+*/
+static int pool_slab_find(const pool_allocator_t* pool, const void* ptr)
+{
+	for(uint32_t used = pool->slab_used; used; used &= used - 1) {
+		size_t s = __builtin_ctz(used);
+		if((uintptr_t)ptr - (uintptr_t)pool->slabs[s].base < pool->slab_size) {
+			return s;
 		}
+	}
+	return -1;
+}
 
-		// The freed block now points to the allocation pointer
-		uint16_t pa = pool_controller.pool_allocators[pool_idx];
-		*(uint16_t*)ptr = pa;
+/* Whether slab s, whose blocks are all free, goes back to its source
+ * under the rebalance policy. Caller holds the pool lock.
+*/
+static bool pool_slab_is_spare(const pool_allocator_t* pool, size_t s)
+{
+	switch(pool->rebalance) {
+		case POOL_REBALANCE_EAGER:
+			return true;
+		case POOL_REBALANCE_SPARE:
+			return pool->slab_available & pool->pool_slabs[pool->slabs[s].pool_idx] & ~(1u << s);
+		default:
+			return false;
+	}
+}
+
+/* Return ptr to the growth slab holding it.
+ *
+ * Returns the pool of the slab, or -1 if ptr is in no slab. Caller
+ * holds the pool lock.
+*/
+static int pool_slab_push(pool_allocator_t* pool, void* ptr)
+{
+	int s = pool_slab_find(pool, ptr);
+	if(s < 0) {
+		return -1;
+	}
 
-		// The allocation pointer now points to the freed block
-		uint16_t ptr_idx = ((uint8_t*)ptr - &g_pool_heap[0]);
-		pool_controller.pool_allocators[pool_idx] = ptr_idx; 
+	pool_slab_t* slab = &pool->slabs[s];
+	size_t offset = (uintptr_t)ptr - (uintptr_t)slab->base;
+	pool_link_write(slab->base, offset, slab->free);
+	slab->free = offset;
+	slab->used--;
+	pool->slab_available |= 1u << s;
+
+	int pool_idx = slab->pool_idx;
+	if(!slab->used && pool_slab_is_spare(pool, s)) {
+		pool_slab_release(pool, s);
 	}
+	return pool_idx;
 }
 
-int main() {
-	TestRunner();
-	return 0; 
-}
\ No newline at end of file
+#if !POOL_LOCK_FREE
+/* Returns true if every block of pool_idx is free and it was used
+ * since initialization or its last trim. Caller holds the pool lock.
+*/
+static bool pool_is_unused(const pool_allocator_t* pool, size_t pool_idx)
+{
+	if(pool->bitmap) {
+		size_t blocks = (pool->pool_end_indices[pool_idx] - pool->pool_begin_indices[pool_idx]) /
+		                pool->block_sizes[pool_idx] + 1;
+		return (pool->pool_bumps[pool_idx] != pool->pool_begin_indices[pool_idx]) &&
+		       (pool->bitmap_free[pool_idx] == blocks);
+	}
+
+	size_t block_size = pool->block_sizes[pool_idx];
+	size_t begin = pool->pool_begin_indices[pool_idx];
+	size_t end = pool->pool_end_indices[pool_idx];
+	size_t bump = pool->pool_bumps[pool_idx];
+	pool_link_t block_idx = pool->pool_allocators[pool_idx];
+
+	if(pool->pool_full[pool_idx] || ((block_idx == POOL_NULL_LINK) && (bump == begin))) {
+		return false;
+	}
+
+	// Free list blocks plus never-used blocks
+	size_t free_blocks = (bump <= end) ? (end - bump) / block_size + 1 : 0;
+	for(; block_idx != POOL_NULL_LINK; block_idx = pool_link_read(pool->heap, block_idx)) {
+		free_blocks++;
+	}
+	return free_blocks == (end - begin) / block_size + 1;
+}
+#endif
+
+size_t pool_trim(pool_allocator_t* pool)
+{
+	size_t released = 0;
+
+	POOL_LOCK(pool);
+	for(uint32_t used = pool->slab_used; used; used &= used - 1) {
+		size_t s = __builtin_ctz(used);
+		if(!pool->slabs[s].used) {
+			pool_slab_release(pool, s);
+			released++;
+		}
+	}
+
+#if !POOL_LOCK_FREE
+	/* Return the pages of unused pools of a mapped heap to the system.
+	 * Their free lists would be zeroed with the pages, so the pools start
+	 * over lazily from their first block.
+	 */
+	size_t page_mask = sysconf(_SC_PAGESIZE) - 1;
+	for(size_t i = 0; pool->mapping && (i < pool->num_pools); i++) {
+		if(pool_is_unused(pool, i)) {
+			uintptr_t begin = (uintptr_t)&pool->heap[pool->pool_begin_indices[i]];
+			uintptr_t end = (uintptr_t)&pool->heap[pool->pool_end_indices[i]] + pool->block_sizes[i];
+			begin = (begin + page_mask) & ~page_mask;
+			end &= ~page_mask;
+			if(begin < end) {
+				madvise((void*)begin, end - begin, MADV_DONTNEED);
+			}
+
+			pool->pool_allocators[i] = POOL_NULL_LINK;
+			pool->pool_bumps[i] = pool->pool_begin_indices[i];
+			released++;
+		}
+	}
+#endif
+	POOL_UNLOCK(pool);
+
+	return released;
+}
+
+void* pool_slab_acquire_parent(size_t size, void* ctx)
+{
+	return pool_malloc_from(ctx, size);
+}
+
+void pool_slab_release_parent(void* slab, size_t size, void* ctx)
+{
+	(void)size;
+	pool_free_to(ctx, slab);
+}
+
+void* pool_slab_acquire_mmap(size_t size, void* ctx)
+{
+	(void)ctx;
+	void* slab = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return (slab == MAP_FAILED) ? NULL : slab;
+}
+
+void pool_slab_release_mmap(void* slab, size_t size, void* ctx)
+{
+	(void)ctx;
+	munmap(slab, size);
+}
+
+#if POOL_LOCK_FREE
+/* Carve a never-used block of a lazy pool whose free list is empty.
+ *
+ * Returns false if the pool has no never-used blocks left.
+*/
+static inline bool pool_bump_lock_free(pool_allocator_t* pool, size_t pool_idx, pool_link_t* block_idx)
+{
+	size_t block_size = pool->block_sizes[pool_idx];
+	size_t bump = atomic_fetch_add_explicit(&pool->pool_bumps[pool_idx], block_size,
+	                                        memory_order_relaxed);
+	if(bump > pool->pool_end_indices[pool_idx]) {
+		return false;
+	}
+
+	*block_idx = bump;
+	if(bump + block_size > pool->pool_end_indices[pool_idx]) {
+		POOL_TRACE(2, POOL_EVENT_POOL_FULL, pool_idx, &pool->heap[bump], block_size);
+	}
+	return true;
+}
+
+/* Lock-free counterpart of pool_pop(), for any pool.
+ *
+ * The link of the head block may be overwritten by a thread that popped
+ * it concurrently. That only happens if the head changed since it was
+ * loaded, in which case the tag makes the swap fail and the pop retries.
+ *
+ * Returns false if the pool is full.
+*/
+static inline bool pool_pop_lock_free(pool_allocator_t* pool, size_t pool_idx, pool_link_t* block_idx)
+{
+	_Atomic uint64_t* pool_head = &pool->pool_heads[pool_idx];
+	uint64_t head = atomic_load_explicit(pool_head, memory_order_acquire);
+	uint64_t next_head;
+	pool_link_t next_block_idx;
+
+	do {
+		if(POOL_HEAD_INDEX(head) == POOL_NULL_LINK) {
+			return pool_bump_lock_free(pool, pool_idx, block_idx);
+		}
+		next_block_idx = __atomic_load_n((pool_link_t*)&pool->heap[POOL_HEAD_INDEX(head)],
+		                                 __ATOMIC_RELAXED);
+		next_head = POOL_HEAD(next_block_idx, POOL_HEAD_TAG(head) + 1);
+	} while(!atomic_compare_exchange_weak_explicit(pool_head, &head, next_head,
+	                                               memory_order_acquire,
+	                                               memory_order_acquire));
+
+	*block_idx = POOL_HEAD_INDEX(head);
+	if((next_block_idx == POOL_NULL_LINK) &&
+	   (atomic_load_explicit(&pool->pool_bumps[pool_idx], memory_order_relaxed) >
+	    pool->pool_end_indices[pool_idx])) {
+		POOL_TRACE(2, POOL_EVENT_POOL_FULL, pool_idx, &pool->heap[*block_idx],
+		           pool->block_sizes[pool_idx]);
+	}
+	return true;
+}
+
+/* Push the chain of blocks first..last, already linked from first to
+ * last, onto the free list of pool_idx in a single swap.
+*/
+static inline void pool_push_chain_lock_free(pool_allocator_t* pool, size_t pool_idx,
+                                             pool_link_t first, pool_link_t last)
+{
+	_Atomic uint64_t* pool_head = &pool->pool_heads[pool_idx];
+	uint64_t head = atomic_load_explicit(pool_head, memory_order_relaxed);
+	uint64_t next_head;
+
+	do {
+		// The last block now points to the current head
+		__atomic_store_n((pool_link_t*)&pool->heap[last], (pool_link_t)POOL_HEAD_INDEX(head),
+		                 __ATOMIC_RELAXED);
+		next_head = POOL_HEAD(first, POOL_HEAD_TAG(head) + 1);
+	} while(!atomic_compare_exchange_weak_explicit(pool_head, &head, next_head,
+	                                               memory_order_release,
+	                                               memory_order_relaxed));
+}
+
+/* Lock-free counterpart of pool_push()
+*/
+static inline void pool_push_lock_free(pool_allocator_t* pool, size_t pool_idx, pool_link_t block_idx)
+{
+	pool_push_chain_lock_free(pool, pool_idx, block_idx, block_idx);
+}
+
+/* Pop up to count blocks of pool_idx in a single swap, storing their
+ * addresses in out.
+ *
+ * The chain is walked before the swap, so its links may be overwritten
+ * concurrently. The swap then fails on the tag, and indices outside the
+ * pool are never followed.
+ *
+ * Returns the number of blocks popped, 0 if the free list is empty.
+*/
+static inline size_t pool_pop_chain_lock_free(pool_allocator_t* pool, size_t pool_idx,
+                                              size_t count, void** out)
+{
+	_Atomic uint64_t* pool_head = &pool->pool_heads[pool_idx];
+	uint64_t head = atomic_load_explicit(pool_head, memory_order_acquire);
+	size_t begin = pool->pool_begin_indices[pool_idx];
+	size_t end = pool->pool_end_indices[pool_idx];
+	size_t popped;
+	pool_link_t block_idx;
+
+	do {
+		popped = 0;
+		block_idx = POOL_HEAD_INDEX(head);
+		while((popped < count) && (block_idx >= begin) && (block_idx <= end)) {
+			out[popped++] = &pool->heap[block_idx];
+			block_idx = __atomic_load_n((pool_link_t*)&pool->heap[block_idx], __ATOMIC_RELAXED);
+		}
+		if(!popped) {
+			return 0;
+		}
+	} while(!atomic_compare_exchange_weak_explicit(pool_head, &head,
+	                                               POOL_HEAD(block_idx, POOL_HEAD_TAG(head) + 1),
+	                                               memory_order_acquire,
+	                                               memory_order_acquire));
+
+	return popped;
+}
+#endif
+
+/* Usage Accounting
+ *
+ * Counters shared by threads are updated with relaxed atomics, they are
+ * statistics only and never order other memory accesses.
+*/
+#if POOL_THREAD_SAFE || POOL_LOCK_FREE
+#define POOL_COUNT(counter, count)	__atomic_fetch_add(&(counter), (count), __ATOMIC_RELAXED)
+#define POOL_COUNT_READ(counter)	__atomic_load_n(&(counter), __ATOMIC_RELAXED)
+#else
+#define POOL_COUNT(counter, count)	((counter) += (count))
+#define POOL_COUNT_READ(counter)	(counter)
+#endif
+
+/* Blocks of pool_idx in use. Concurrent frees may be counted before
+ * their allocations, so the difference is signed.
+*/
+static inline ptrdiff_t pool_count_in_use(const pool_allocator_t* pool, size_t pool_idx)
+{
+	return (ptrdiff_t)(POOL_COUNT_READ(pool->alloc_counts[pool_idx]) -
+	                   POOL_COUNT_READ(pool->free_counts[pool_idx]));
+}
+
+/* Raise the high-water mark of pool_idx to in_use blocks if it is lower
+*/
+static void pool_count_high_water(pool_allocator_t* pool, size_t pool_idx, ptrdiff_t in_use)
+{
+#if POOL_THREAD_SAFE || POOL_LOCK_FREE
+	size_t high_water = __atomic_load_n(&pool->high_water[pool_idx], __ATOMIC_RELAXED);
+	while((in_use > (ptrdiff_t)high_water) &&
+	      !__atomic_compare_exchange_n(&pool->high_water[pool_idx], &high_water, in_use, true,
+	                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
+#else
+	if(in_use > (ptrdiff_t)pool->high_water[pool_idx]) {
+		pool->high_water[pool_idx] = in_use;
+	}
+#endif
+}
+
+/* Account for count blocks of pool_idx handed out
+*/
+static void pool_count_alloc(pool_allocator_t* pool, size_t pool_idx, size_t count)
+{
+	POOL_COUNT(pool->alloc_counts[pool_idx], count);
+	pool_count_high_water(pool, pool_idx, pool_count_in_use(pool, pool_idx));
+}
+
+static inline void pool_count_free(pool_allocator_t* pool, size_t pool_idx, size_t count)
+{
+	POOL_COUNT(pool->free_counts[pool_idx], count);
+}
+
+#if POOL_THREAD_SAFE
+/* Add the usage counts a thread cache holds back to its owner.
+*/
+static void pool_tcache_count_flush(pool_tcache_t* tcache, size_t pool_idx)
+{
+	pool_allocator_t* pool = tcache->owner;
+	if(!tcache->pending_allocs[pool_idx] && !tcache->pending_frees[pool_idx]) {
+		return;
+	}
+
+	// The thread's peak is applied on top of the usage it started from
+	ptrdiff_t in_use = pool_count_in_use(pool, pool_idx);
+	POOL_COUNT(pool->alloc_counts[pool_idx], tcache->pending_allocs[pool_idx]);
+	POOL_COUNT(pool->free_counts[pool_idx], tcache->pending_frees[pool_idx]);
+	pool_count_high_water(pool, pool_idx, in_use + tcache->pending_peaks[pool_idx]);
+
+	tcache->pending_allocs[pool_idx] = 0;
+	tcache->pending_frees[pool_idx] = 0;
+	tcache->pending_peaks[pool_idx] = 0;
+}
+
+/* Count an allocation (or free) served by a thread cache, adding the
+ * counts to the owner once per POOL_TCACHE_BATCH operations.
+*/
+static inline void pool_tcache_count(pool_tcache_t* tcache, size_t pool_idx, bool alloc)
+{
+	if(alloc) {
+		int ahead = ++tcache->pending_allocs[pool_idx] - tcache->pending_frees[pool_idx];
+		if(ahead > tcache->pending_peaks[pool_idx]) {
+			tcache->pending_peaks[pool_idx] = ahead;
+		}
+	}
+	else {
+		tcache->pending_frees[pool_idx]++;
+	}
+
+	if(tcache->pending_allocs[pool_idx] + tcache->pending_frees[pool_idx] >= POOL_TCACHE_BATCH) {
+		pool_tcache_count_flush(tcache, pool_idx);
+	}
+}
+
+/* Return the count oldest blocks of a magazine to their shared pool
+*/
+static void pool_tcache_flush(pool_tcache_t* tcache, size_t pool_idx, uint16_t count)
+{
+	pool_allocator_t* pool = tcache->owner;
+	pool_magazine_t* magazine = &tcache->magazines[pool_idx];
+	if(!count) {
+		return;
+	}
+
+	POOL_LOCK(pool);
+	for(uint16_t i = 0; i < count; i++) {
+		pool_push(pool, pool_idx, magazine->blocks[i]);
+	}
+	POOL_UNLOCK(pool);
+
+	magazine->count -= count;
+	for(uint16_t i = 0; i < magazine->count; i++) {
+		magazine->blocks[i] = magazine->blocks[i + count];
+	}
+	if(!magazine->count) {
+		tcache->stocked &= ~(1u << pool_idx);
+	}
+}
+
+// Whether a cache holds no block and no count for its owner
+static bool pool_tcache_is_empty(const pool_tcache_t* tcache)
+{
+	if(tcache->stocked) {
+		return false;
+	}
+	for(size_t i = 0; i < MAX_POOLS; i++) {
+		if(tcache->pending_allocs[i] || tcache->pending_frees[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Bind a cache to owner, NULL to unbind it. POOL_DEBUG builds count the
+ * caches bound to each instance, see pool_destroy().
+*/
+static inline void pool_tcache_set_owner(pool_tcache_t* tcache, pool_allocator_t* owner)
+{
+#if POOL_DEBUG
+	if(tcache->owner) {
+		__atomic_sub_fetch(&tcache->owner->bound_tcaches, 1, __ATOMIC_RELAXED);
+	}
+	if(owner) {
+		__atomic_add_fetch(&owner->bound_tcaches, 1, __ATOMIC_RELAXED);
+	}
+#endif
+	tcache->owner = owner;
+}
+
+/* Return every cached block to its owner, unless the owner was
+ * re-initialized since the blocks were cached, and unbind the cache.
+ *
+ * Empty and unbound caches are left without touching their owner, which
+ * may have been destroyed after the thread flushed.
+*/
+static void pool_tcache_flush_all(pool_tcache_t* tcache)
+{
+	if(!tcache->owner) {
+		return;
+	}
+	if(!pool_tcache_is_empty(tcache) && (tcache->init_generation == tcache->owner->init_generation)) {
+		for(size_t i = 0; i < tcache->owner->num_pools; i++) {
+			pool_tcache_flush(tcache, i, tcache->magazines[i].count);
+			pool_tcache_count_flush(tcache, i);
+		}
+	}
+	pool_tcache_set_owner(tcache, NULL);
+}
+
+static void pool_tcache_destroy(void* arg)
+{
+	pool_tcache_t* tcaches = arg;
+	for(size_t i = 0; i < POOL_TCACHE_INSTANCES; i++) {
+		pool_tcache_flush_all(&tcaches[i]);
+	}
+}
+
+static void pool_tcache_create_key(void)
+{
+	pthread_key_create(&g_pool_tcache_key, pool_tcache_destroy);
+}
+
+/* Bind one of the calling thread's caches to pool, emptied.
+*/
+static pool_tcache_t* pool_tcache_bind(pool_allocator_t* pool)
+{
+	// Register the exit flush on first use by this thread
+	if(!t_pool_tcache_registered) {
+		pthread_once(&g_pool_tcache_once, pool_tcache_create_key);
+		pthread_setspecific(g_pool_tcache_key, t_pool_tcaches);
+		t_pool_tcache_registered = true;
+	}
+
+	// Prefer a cache already bound to pool, then an unused one
+	pool_tcache_t* tcache = NULL;
+	for(size_t i = 0; !tcache && (i < POOL_TCACHE_INSTANCES); i++) {
+		if(t_pool_tcaches[i].owner == pool) {
+			tcache = &t_pool_tcaches[i];
+		}
+	}
+	for(size_t i = 0; !tcache && (i < POOL_TCACHE_INSTANCES); i++) {
+		if(!t_pool_tcaches[i].owner) {
+			tcache = &t_pool_tcaches[i];
+		}
+	}
+	if(!tcache) {
+		tcache = &t_pool_tcaches[t_pool_tcache_evict++ % POOL_TCACHE_INSTANCES];
+		pool_tcache_flush_all(tcache);
+	}
+
+	for(size_t i = 0; i < MAX_POOLS; i++) {
+		tcache->magazines[i].count = 0;
+		tcache->pending_allocs[i] = 0;
+		tcache->pending_frees[i] = 0;
+		tcache->pending_peaks[i] = 0;
+	}
+	tcache->stocked = 0;
+	pool_tcache_set_owner(tcache, pool);
+	tcache->init_generation = pool->init_generation;
+	return tcache;
+}
+
+/* Calling thread's cache for pool, emptied if pool was re-initialized
+ * since it was last used.
+*/
+static inline pool_tcache_t* pool_tcache_get(pool_allocator_t* pool)
+{
+	for(size_t i = 0; i < POOL_TCACHE_INSTANCES; i++) {
+		pool_tcache_t* tcache = &t_pool_tcaches[i];
+		if((tcache->owner == pool) && (tcache->init_generation == pool->init_generation)) {
+			return tcache;
+		}
+	}
+	return pool_tcache_bind(pool);
+}
+
+/* Refill the magazine of the smallest pool fitting the request, unless
+ * the thread already caches blocks of a smaller fitting pool.
+ *
+ * Returns the mask of fitting pools with a non-empty magazine.
+*/
+static uint32_t pool_tcache_refill(pool_tcache_t* tcache, uint32_t fitting_pools)
+{
+	pool_allocator_t* pool = tcache->owner;
+	uint32_t stocked = tcache->stocked & fitting_pools;
+
+	POOL_LOCK(pool);
+	uint32_t shared = pool->pool_available & fitting_pools;
+	if(shared && (!stocked || (__builtin_ctz(shared) < __builtin_ctz(stocked)))) {
+		size_t pool_idx = __builtin_ctz(shared);
+		pool_magazine_t* magazine = &tcache->magazines[pool_idx];
+
+		while((magazine->count < POOL_TCACHE_BATCH) &&
+		      !pool->pool_full[pool_idx]) {
+			magazine->blocks[magazine->count++] = pool_pop(pool, pool_idx);
+		}
+		tcache->stocked |= 1u << pool_idx;
+
+		// Reverse so blocks are handed out in free list order
+		for(uint16_t i = 0; i < magazine->count / 2; i++) {
+			pool_link_t block_idx = magazine->blocks[i];
+			magazine->blocks[i] = magazine->blocks[magazine->count - 1 - i];
+			magazine->blocks[magazine->count - 1 - i] = block_idx;
+		}
+	}
+	POOL_UNLOCK(pool);
+
+	return tcache->stocked & fitting_pools;
+}
+#endif
+
+void pool_thread_cache_flush(void)
+{
+#if POOL_THREAD_SAFE
+	for(size_t i = 0; i < POOL_TCACHE_INSTANCES; i++) {
+		pool_tcache_flush_all(&t_pool_tcaches[i]);
+	}
+#endif
+}
+
+void pool_get_stats_from(pool_allocator_t* pool, pool_stats_t* stats)
+{
+#if POOL_THREAD_SAFE
+	// Add the calling thread's held back counts
+	for(size_t i = 0; i < POOL_TCACHE_INSTANCES; i++) {
+		pool_tcache_t* tcache = &t_pool_tcaches[i];
+		if((tcache->owner == pool) && (tcache->init_generation == pool->init_generation)) {
+			for(size_t j = 0; j < pool->num_pools; j++) {
+				pool_tcache_count_flush(tcache, j);
+			}
+		}
+	}
+#endif
+
+	stats->heap_size = pool->heap_size;
+	stats->num_pools = pool->num_pools;
+	stats->unfit = POOL_COUNT_READ(pool->unfit_count);
+
+	POOL_LOCK(pool);
+	stats->reserve_free = __builtin_popcount(pool->reserve_free);
+	stats->double_frees = pool->double_free_count;
+	for(size_t i = 0; i < pool->num_pools; i++) {
+		pool_usage_t* usage = &stats->pools[i];
+		usage->block_size = pool->block_sizes[i];
+		usage->slabs = __builtin_popcount(pool->pool_slabs[i]);
+		usage->blocks = (pool->pool_end_indices[i] - pool->pool_begin_indices[i]) / usage->block_size + 1 +
+		                usage->slabs * (pool->slab_size / usage->block_size);
+		usage->frees = POOL_COUNT_READ(pool->free_counts[i]);
+		usage->allocs = POOL_COUNT_READ(pool->alloc_counts[i]);
+		usage->in_use = (usage->allocs > usage->frees) ? usage->allocs - usage->frees : 0;
+		usage->high_water = POOL_COUNT_READ(pool->high_water[i]);
+		usage->failures = POOL_COUNT_READ(pool->fail_counts[i]);
+		usage->spills = POOL_COUNT_READ(pool->spill_counts[i]);
+		usage->spill_bytes = POOL_COUNT_READ(pool->spill_bytes[i]);
+	}
+	POOL_UNLOCK(pool);
+}
+
+size_t pool_visit_live_from(pool_allocator_t* pool, pool_visit_t visit, void* ctx)
+{
+	size_t visited = 0;
+	if(!pool->bitmap) {
+		return 0;
+	}
+
+	POOL_LOCK(pool);
+	for(size_t i = 0; i < pool->num_pools; i++) {
+		size_t block_size = pool->block_sizes[i];
+		size_t blocks = (pool->pool_end_indices[i] - pool->pool_begin_indices[i]) / block_size + 1;
+		const uint64_t* bitmap = pool_bitmap(pool, i);
+		uint8_t* begin = &pool->heap[pool->pool_begin_indices[i]];
+
+		for(size_t word = 0; word < (blocks + 63) / 64; word++) {
+			// Leave out the bits past the last block
+			uint64_t live = bitmap[word];
+			if((word == blocks / 64) && (blocks % 64)) {
+				live &= ~(~0ull << (blocks % 64));
+			}
+			for(; live; live &= live - 1) {
+				visit(begin + (word * 64 + __builtin_ctzll(live)) * block_size, block_size, ctx);
+				visited++;
+			}
+		}
+	}
+	POOL_UNLOCK(pool);
+	return visited;
+}
+
+bool pool_dump_stats(const pool_stats_t* stats, FILE* out)
+{
+	bool pass = fprintf(out, "{\"heap_size\":%zu,\"num_pools\":%zu,\"unfit\":%zu,\"reserve_free\":%zu,"
+	                    "\"double_frees\":%zu,\"pools\":[",
+	                    stats->heap_size, stats->num_pools, stats->unfit, stats->reserve_free,
+	                    stats->double_frees) >= 0;
+
+	for(size_t i = 0; pass && (i < stats->num_pools); i++) {
+		const pool_usage_t* usage = &stats->pools[i];
+		pass = fprintf(out, "%s{\"block_size\":%zu,\"blocks\":%zu,\"in_use\":%zu,\"high_water\":%zu,"
+		               "\"allocs\":%zu,\"frees\":%zu,\"failures\":%zu,\"spills\":%zu,"
+		               "\"spill_bytes\":%zu,\"slabs\":%zu}",
+		               i ? "," : "", usage->block_size, usage->blocks, usage->in_use, usage->high_water,
+		               usage->allocs, usage->frees, usage->failures, usage->spills,
+		               usage->spill_bytes, usage->slabs) >= 0;
+	}
+
+	return pass && (fprintf(out, "]}\n") >= 0);
+}
+
+/* Account for a request of best_pool_idx served by pool_idx instead
+*/
+static void pool_count_spill(pool_allocator_t* pool, size_t best_pool_idx, size_t pool_idx)
+{
+	POOL_COUNT(pool->spill_counts[best_pool_idx], 1);
+	POOL_COUNT(pool->spill_bytes[best_pool_idx], pool->block_sizes[pool_idx] - pool->block_sizes[best_pool_idx]);
+}
+
+/* Allocate n bytes from the first available pool of fitting_pools,
+ * growing the first one if it is exhausted and may_grow is set.
+*/
+static inline void* pool_malloc_fitting(pool_allocator_t* pool, size_t n, uint32_t fitting_pools,
+                                        bool may_grow)
+{
+	(void)n; // Only traced
+	(void)may_grow; // Unused by POOL_LOCK_FREE builds
+	void* store_addr = NULL; 
+	size_t pool_idx = 0;
+
+#if POOL_THREAD_SAFE
+	// Serve from the magazine of the best fitting pool, refilling if empty
+	if(fitting_pools) {
+		pool_tcache_t* tcache = pool_tcache_get(pool);
+		uint32_t best_pool = fitting_pools & -fitting_pools;
+		uint32_t candidates = (tcache->stocked & best_pool) ? best_pool :
+		                      pool_tcache_refill(tcache, fitting_pools);
+		if(may_grow && pool->slab_acquire && !(candidates & best_pool)) {
+			// Grow the exhausted best fitting pool before spilling
+			pool_idx = __builtin_ctz(best_pool);
+			POOL_LOCK(pool);
+			store_addr = pool_slab_pop(pool, pool_idx);
+			POOL_UNLOCK(pool);
+		}
+		if(!store_addr && candidates) {
+			pool_idx = __builtin_ctz(candidates);
+			pool_magazine_t* magazine = &tcache->magazines[pool_idx];
+			store_addr = &pool->heap[magazine->blocks[--magazine->count]];
+			if(!magazine->count) {
+				tcache->stocked &= ~(1u << pool_idx);
+			}
+		}
+		if(store_addr) {
+			pool_tcache_count(tcache, pool_idx, true);
+		}
+	}
+#elif POOL_LOCK_FREE
+	// Pop from the first fitting pool whose free list is not empty
+	uint32_t candidates = fitting_pools;
+	pool_link_t store_idx;
+	while(candidates) {
+		pool_idx = __builtin_ctz(candidates);
+		if(pool_pop_lock_free(pool, pool_idx, &store_idx)) {
+			store_addr = &pool->heap[store_idx];
+			break;
+		}
+		candidates &= candidates - 1;
+	}
+#else
+	// Find first non-full pool index that can store object of size n
+	uint32_t candidates = pool->pool_available & fitting_pools;
+	if(may_grow && pool->slab_acquire && fitting_pools &&
+	   !(candidates & fitting_pools & -fitting_pools)) {
+		// Grow the exhausted best fitting pool before spilling
+		pool_idx = __builtin_ctz(fitting_pools);
+		store_addr = pool_slab_pop(pool, pool_idx);
+	}
+	if(!store_addr && candidates) {
+		pool_idx = __builtin_ctz(candidates);
+		store_addr = &pool->heap[pool_pop(pool, pool_idx)]; 
+	}
+#endif
+
+	if(store_addr) {
+		size_t best_pool_idx = __builtin_ctz(fitting_pools);
+		if(pool_idx != best_pool_idx) {
+			pool_count_spill(pool, best_pool_idx, pool_idx);
+		}
+#if !POOL_THREAD_SAFE
+		pool_count_alloc(pool, pool_idx, 1);
+#endif
+		POOL_TRACE(2, POOL_EVENT_MALLOC, pool_idx, store_addr, n);
+	}
+	else {
+		if(fitting_pools) {
+			POOL_COUNT(pool->fail_counts[__builtin_ctz(fitting_pools)], 1);
+		}
+		else {
+			POOL_COUNT(pool->unfit_count, 1);
+		}
+		POOL_TRACE(1, POOL_EVENT_MALLOC_FAILED, 0, NULL, n);
+	}
+
+	return store_addr; 
+}
+
+void* pool_malloc_from(pool_allocator_t* pool, size_t n)
+{
+	return pool_malloc_fitting(pool, n, pool->size_class_pools[size_class_of(n)], true);
+}
+
+void* pool_malloc_class_from(pool_allocator_t* pool, size_t size_class, size_t n)
+{
+	return pool_malloc_fitting(pool, n, pool->size_class_pools[size_class], true);
+}
+
+void* pool_aligned_malloc_from(pool_allocator_t* pool, size_t n, size_t align)
+{
+	if(!align || (align & (align - 1))) {
+		return NULL;
+	}
+
+	/* Blocks at least align bytes large are aligned to align up to a
+	 * cache line, so the request is served like one of align bytes by
+	 * pools meeting the alignment. Growth slabs are aligned to a cache
+	 * line only.
+	 */
+	size_t align_class = __builtin_ctzll(align);
+	uint32_t fitting_pools = pool->size_class_pools[size_class_of((n > align) ? n : align)] &
+	                         pool->align_pools[align_class];
+	return pool_malloc_fitting(pool, n, fitting_pools, align <= POOL_CACHE_LINE);
+}
+
+/* Return the block at heap index ptr_idx to pool_idx
+*/
+static inline void pool_free_block(pool_allocator_t* pool, size_t pool_idx, pool_link_t ptr_idx)
+{
+#if POOL_THREAD_SAFE
+	// Cache the block, flushing the oldest half of a full magazine
+	pool_tcache_t* tcache = pool_tcache_get(pool);
+	pool_magazine_t* magazine = &tcache->magazines[pool_idx];
+	if(magazine->count == POOL_TCACHE_SIZE) {
+		pool_tcache_flush(tcache, pool_idx, POOL_TCACHE_BATCH);
+	}
+	magazine->blocks[magazine->count++] = ptr_idx;
+	tcache->stocked |= 1u << pool_idx;
+	pool_tcache_count(tcache, pool_idx, false);
+#elif POOL_LOCK_FREE
+	pool_push_lock_free(pool, pool_idx, ptr_idx);
+	pool_count_free(pool, pool_idx, 1);
+#else
+	pool_push(pool, pool_idx, ptr_idx);
+	pool_count_free(pool, pool_idx, 1);
+#endif
+
+	POOL_TRACE(2, POOL_EVENT_FREE, pool_idx, &pool->heap[ptr_idx], pool->block_sizes[pool_idx]);
+}
+
+void pool_free_to(pool_allocator_t* pool, void* ptr)
+{
+	if(ptr && ((uintptr_t)ptr - (uintptr_t)pool->heap >= pool->reserve_begin)) {
+		// Past the pools, the block belongs to a growth slab
+		POOL_LOCK(pool);
+		int pool_idx = pool_slab_push(pool, ptr);
+		POOL_UNLOCK(pool);
+
+		if(pool_idx >= 0) {
+			pool_count_free(pool, pool_idx, 1);
+			POOL_TRACE(2, POOL_EVENT_FREE, pool_idx, ptr, pool->block_sizes[pool_idx]);
+		}
+	}
+	else if(ptr) {
+		// Find which pool the memory belongs to
+		pool_link_t ptr_idx = ((uint8_t*)ptr - pool->heap);
+		pool_free_block(pool, pool_index_of(pool, ptr_idx), ptr_idx);
+	}
+}
+
+void pool_free_sized_to(pool_allocator_t* pool, void* ptr, size_t n)
+{
+	pool_free_class_to(pool, ptr, size_class_of(n));
+}
+
+void pool_free_class_to(pool_allocator_t* pool, void* ptr, size_t size_class)
+{
+	// The best fitting pool for the size class owns the block, unless it spilled
+	uint32_t fitting_pools = pool->size_class_pools[size_class];
+	uintptr_t ptr_idx = (uintptr_t)ptr - (uintptr_t)pool->heap;
+	size_t pool_idx = __builtin_ctz(fitting_pools | (1u << MAX_POOLS));
+
+	if(!fitting_pools || (ptr_idx < pool->pool_begin_indices[pool_idx]) ||
+	   (ptr_idx > pool->pool_end_indices[pool_idx])) {
+#if POOL_DEBUG
+		// Only a block able to hold the class may have spilled out of
+		// its best fitting pool
+		assert(!ptr || (pool_usable_size_from(pool, ptr) >= size_class_size(size_class)));
+#endif
+		pool_free_to(pool, ptr);
+		return;
+	}
+	pool_free_block(pool, pool_idx, ptr_idx);
+}
+
+size_t pool_usable_size_from(pool_allocator_t* pool, const void* ptr)
+{
+	uintptr_t ptr_idx = (uintptr_t)ptr - (uintptr_t)pool->heap;
+	if(!ptr) {
+		return 0;
+	}
+	if(ptr_idx < pool->reserve_begin) {
+		return pool->block_sizes[pool_index_of(pool, ptr_idx)];
+	}
+
+	// Past the pools, the block belongs to a growth slab
+	POOL_LOCK(pool);
+	int s = pool_slab_find(pool, ptr);
+	size_t usable = (s >= 0) ? pool->block_sizes[pool->slabs[s].pool_idx] : 0;
+	POOL_UNLOCK(pool);
+	return usable;
+}
+
+void* pool_realloc_from(pool_allocator_t* pool, void* ptr, size_t n)
+{
+	if(!ptr) {
+		return pool_malloc_from(pool, n);
+	}
+	if(!n) {
+		pool_free_to(pool, ptr);
+		return NULL;
+	}
+
+	size_t usable = pool_usable_size_from(pool, ptr);
+	if(!usable) {
+		return NULL;
+	}
+
+	// Stay in the block while it fits and no smaller pool would
+	uint32_t fitting_pools = pool->size_class_pools[size_class_of(n)];
+	size_t best = __builtin_ctz(fitting_pools | (1u << MAX_POOLS));
+	if((n <= usable) && (!fitting_pools || (pool->block_sizes[best] >= usable))) {
+		return ptr;
+	}
+
+	void* moved = pool_malloc_from(pool, n);
+	if(moved && (n <= usable) && (pool_usable_size_from(pool, moved) >= usable)) {
+		// Spilled to a block no smaller than the current one
+		pool_free_to(pool, moved);
+		moved = NULL;
+	}
+	if(!moved) {
+		// A shrinking block can always stay where it is
+		return (n <= usable) ? ptr : NULL;
+	}
+	memcpy(moved, ptr, (n < usable) ? n : usable);
+	pool_free_to(pool, ptr);
+	return moved;
+}
+
+/* Take up to count blocks of pool_idx at once, storing their addresses
+ * in out. Stops early when the pool's heap blocks run out.
+ *
+ * Returns the number of blocks taken.
+*/
+static inline size_t pool_pop_bulk(pool_allocator_t* pool, size_t pool_idx, size_t count, void** out)
+{
+	size_t popped = 0;
+
+#if POOL_LOCK_FREE
+	popped = pool_pop_chain_lock_free(pool, pool_idx, count, out);
+#else
+#if POOL_THREAD_SAFE
+	// Drain the calling thread's magazine before locking the shared pool
+	pool_tcache_t* tcache = pool_tcache_get(pool);
+	pool_magazine_t* magazine = &tcache->magazines[pool_idx];
+	while((popped < count) && magazine->count) {
+		out[popped++] = &pool->heap[magazine->blocks[--magazine->count]];
+	}
+	if(!magazine->count) {
+		tcache->stocked &= ~(1u << pool_idx);
+	}
+	if(popped == count) {
+		return popped;
+	}
+#endif
+
+	POOL_LOCK(pool);
+	while((popped < count) && !pool->pool_full[pool_idx]) {
+		out[popped++] = &pool->heap[pool_pop(pool, pool_idx)];
+	}
+	POOL_UNLOCK(pool);
+#endif
+
+	return popped;
+}
+
+size_t pool_malloc_bulk_from(pool_allocator_t* pool, size_t n, size_t count, void** out)
+{
+	uint32_t fitting_pools = pool->size_class_pools[size_class_of(n)];
+	size_t allocated = 0;
+
+	// Chain off the best fitting pool first
+	if(fitting_pools && count) {
+		size_t pool_idx = __builtin_ctz(fitting_pools);
+		allocated = pool_pop_bulk(pool, pool_idx, count, out);
+		if(allocated) {
+			pool_count_alloc(pool, pool_idx, allocated);
+		}
+		for(size_t i = 0; i < allocated; i++) {
+			POOL_TRACE(2, POOL_EVENT_MALLOC, pool_idx, out[i], n);
+		}
+	}
+
+	// Then grow or spill block by block, as pool_malloc() would
+	while((allocated < count) && (out[allocated] = pool_malloc_fitting(pool, n, fitting_pools, true))) {
+		allocated++;
+	}
+
+	return allocated;
+}
+
+void pool_free_bulk_to(pool_allocator_t* pool, void** ptrs, size_t count)
+{
+#if POOL_LOCK_FREE
+	// Link the blocks of each pool into one chain, pushed with a single swap
+	pool_link_t firsts[MAX_POOLS];
+	pool_link_t lasts[MAX_POOLS];
+	size_t freed[MAX_POOLS] = {0};
+	uint32_t chained = 0;
+
+	for(size_t i = 0; i < count; i++) {
+		if(ptrs[i]) {
+			pool_link_t ptr_idx = ((uint8_t*)ptrs[i] - pool->heap);
+			size_t pool_idx = pool_index_of(pool, ptr_idx);
+			if(chained & (1u << pool_idx)) {
+				__atomic_store_n((pool_link_t*)&pool->heap[ptr_idx], firsts[pool_idx], __ATOMIC_RELAXED);
+			}
+			else {
+				lasts[pool_idx] = ptr_idx;
+				chained |= 1u << pool_idx;
+			}
+			firsts[pool_idx] = ptr_idx;
+			freed[pool_idx]++;
+			POOL_TRACE(2, POOL_EVENT_FREE, pool_idx, ptrs[i], pool->block_sizes[pool_idx]);
+		}
+	}
+	for(; chained; chained &= chained - 1) {
+		size_t pool_idx = __builtin_ctz(chained);
+		pool_push_chain_lock_free(pool, pool_idx, firsts[pool_idx], lasts[pool_idx]);
+		pool_count_free(pool, pool_idx, freed[pool_idx]);
+	}
+#else
+	// Bypass the thread cache, returning every block under one lock
+	size_t freed[MAX_POOLS] = {0};
+	POOL_LOCK(pool);
+	for(size_t i = 0; i < count; i++) {
+		int pool_idx = -1;
+		if(ptrs[i] && ((uintptr_t)ptrs[i] - (uintptr_t)pool->heap >= pool->reserve_begin)) {
+			pool_idx = pool_slab_push(pool, ptrs[i]);
+		}
+		else if(ptrs[i]) {
+			pool_link_t ptr_idx = ((uint8_t*)ptrs[i] - pool->heap);
+			pool_idx = pool_index_of(pool, ptr_idx);
+			pool_push(pool, pool_idx, ptr_idx);
+		}
+		if(pool_idx >= 0) {
+			freed[pool_idx]++;
+			POOL_TRACE(2, POOL_EVENT_FREE, pool_idx, ptrs[i], pool->block_sizes[pool_idx]);
+		}
+	}
+	POOL_UNLOCK(pool);
+
+	for(size_t i = 0; i < pool->num_pools; i++) {
+		if(freed[i]) {
+			pool_count_free(pool, i, freed[i]);
+		}
+	}
+#endif
+}
+
+/* NUMA Arenas
+ *
+ * count stays 0 until pool_numa_init() succeeds, so the global API only
+ * pays a predictable branch for them.
+*/
+static struct {
+	pool_allocator_t* arenas[POOL_NUMA_MAX_NODES];
+	size_t count;
+	bool simulated;
+	uint8_t node_arenas[256];	// Arena index of each node ID, see POOL_MAP_NODE()
+} g_pool_numa;
+
+static _Thread_local int t_pool_numa_bound = -1;
+static _Thread_local unsigned t_pool_numa_node;
+static _Thread_local unsigned t_pool_numa_calls;
+
+size_t pool_numa_node(void)
+{
+	if(!g_pool_numa.count) {
+		return 0;
+	}
+	if(t_pool_numa_bound >= 0) {
+		return (size_t)t_pool_numa_bound % g_pool_numa.count;
+	}
+	if(!(t_pool_numa_calls++ % POOL_NUMA_REFRESH)) {
+		// Threads rarely move between nodes, so the lookup is amortized
+		unsigned cpu = 0, node = 0;
+		syscall(SYS_getcpu, &cpu, &node, NULL);
+		t_pool_numa_node = g_pool_numa.simulated ? cpu : node;
+	}
+	if(g_pool_numa.simulated) {
+		return t_pool_numa_node % g_pool_numa.count;
+	}
+	// Nodes without an arena of their own use the first
+	return (t_pool_numa_node < 256) ? g_pool_numa.node_arenas[t_pool_numa_node] % g_pool_numa.count : 0;
+}
+
+// Instance serving the calling thread's global allocations
+static inline pool_allocator_t* pool_global_local(void)
+{
+	if(__builtin_expect(g_pool_numa.count != 0, 0)) {
+		return g_pool_numa.arenas[pool_numa_node()];
+	}
+	return &pool_controller;
+}
+
+// Instance of the global API owning ptr
+static inline pool_allocator_t* pool_global_owner(const void* ptr)
+{
+	for(size_t i = 0; i < g_pool_numa.count; i++) {
+		pool_allocator_t* arena = g_pool_numa.arenas[i];
+		if((uintptr_t)ptr - (uintptr_t)arena->heap < arena->heap_size) {
+			return arena;
+		}
+	}
+	return &pool_controller;
+}
+
+size_t pool_numa_parse_nodes(const char* list, unsigned* nodes, size_t max_nodes)
+{
+	size_t count = 0;
+	const char* cursor = list;
+	while(count < max_nodes) {
+		char* end;
+		unsigned long first = strtoul(cursor, &end, 10);
+		if(end == cursor) {
+			break;
+		}
+		unsigned long last = first;
+		if(*end == '-') {
+			cursor = end + 1;
+			last = strtoul(cursor, &end, 10);
+			if((end == cursor) || (last < first)) {
+				break;
+			}
+		}
+		for(unsigned long node = first; (node <= last) && (count < max_nodes); node++) {
+			nodes[count++] = (unsigned)node;
+		}
+		if(*end != ',') {
+			break;
+		}
+		cursor = end + 1;
+	}
+	return count;
+}
+
+// IDs of the nodes listed in /sys/devices/system/node/online, node 0 if unreadable
+static size_t pool_numa_online_nodes(unsigned* nodes)
+{
+	char list[256] = "0";
+	FILE* online = fopen("/sys/devices/system/node/online", "r");
+	if(online) {
+		if(!fgets(list, sizeof(list), online)) {
+			strcpy(list, "0");
+		}
+		fclose(online);
+	}
+	size_t count = pool_numa_parse_nodes(list, nodes, POOL_NUMA_MAX_NODES);
+	if(!count) {
+		nodes[0] = 0;
+		count = 1;
+	}
+	return count;
+}
+
+void pool_numa_deinit(void)
+{
+	size_t count = g_pool_numa.count;
+	g_pool_numa.count = 0;
+	for(size_t i = 0; i < count; i++) {
+		pool_destroy(g_pool_numa.arenas[i]);
+		g_pool_numa.arenas[i] = NULL;
+	}
+}
+
+bool pool_numa_init(const pool_config_t* config, size_t node_heap_size, size_t simulated_nodes)
+{
+	pool_numa_deinit();
+	if(!config || config->slab_acquire || (simulated_nodes > POOL_NUMA_MAX_NODES)) {
+		return false;
+	}
+
+	unsigned nodes[POOL_NUMA_MAX_NODES];
+	size_t count = simulated_nodes ? simulated_nodes : pool_numa_online_nodes(nodes);
+	memset(g_pool_numa.node_arenas, 0, sizeof(g_pool_numa.node_arenas));
+
+	pool_config_t arena_config = *config;
+	arena_config.lazy = true;
+	for(size_t i = 0; i < count; i++) {
+		unsigned flags = 0;
+		if(!simulated_nodes && (nodes[i] < 256)) {
+			flags = POOL_MAP_NODE(nodes[i]);
+			g_pool_numa.node_arenas[nodes[i]] = (uint8_t)i;
+		}
+		g_pool_numa.arenas[i] = pool_map(node_heap_size, &arena_config, flags);
+		if(!g_pool_numa.arenas[i]) {
+			g_pool_numa.count = i;
+			pool_numa_deinit();
+			return false;
+		}
+	}
+	g_pool_numa.simulated = (simulated_nodes != 0);
+	g_pool_numa.count = count;
+	return true;
+}
+
+size_t pool_numa_node_count(void)
+{
+	return g_pool_numa.count;
+}
+
+pool_allocator_t* pool_numa_arena(size_t node)
+{
+	return (node < g_pool_numa.count) ? g_pool_numa.arenas[node] : NULL;
+}
+
+void pool_numa_bind_thread(int node)
+{
+	t_pool_numa_bound = (node < 0) ? -1 : node;
+	t_pool_numa_calls = 0;
+}
+
+void* pool_malloc(size_t n)
+{
+	return pool_malloc_from(pool_global_local(), n);
+}
+
+void pool_free(void* ptr)
+{
+	pool_free_to(pool_global_owner(ptr), ptr);
+}
+
+void* pool_aligned_malloc(size_t n, size_t align)
+{
+	return pool_aligned_malloc_from(pool_global_local(), n, align);
+}
+
+size_t pool_malloc_bulk(size_t n, size_t count, void** out)
+{
+	return pool_malloc_bulk_from(pool_global_local(), n, count, out);
+}
+
+void pool_free_bulk(void** ptrs, size_t count)
+{
+	if(g_pool_numa.count) {
+		// Blocks may come from several arenas
+		for(size_t i = 0; i < count; i++) {
+			pool_free(ptrs[i]);
+		}
+		return;
+	}
+	pool_free_bulk_to(&pool_controller, ptrs, count);
+}
+
+void pool_free_sized(void* ptr, size_t n)
+{
+	pool_free_sized_to(pool_global_owner(ptr), ptr, n);
+}
+
+void* pool_realloc(void* ptr, size_t n)
+{
+	// Moved blocks stay in their home arena
+	return pool_realloc_from(ptr ? pool_global_owner(ptr) : pool_global_local(), ptr, n);
+}
+
+size_t pool_usable_size(const void* ptr)
+{
+	return pool_usable_size_from(pool_global_owner(ptr), ptr);
+}
+
+void pool_get_stats(pool_stats_t* stats)
+{
+	pool_get_stats_from(&pool_controller, stats);
+}
+
+size_t pool_visit_live(pool_visit_t visit, void* ctx)
+{
+	return pool_visit_live_from(&pool_controller, visit, ctx);
+}
+
+/* Workload Profiles
+*/
+#define POOL_PROFILE_MASK	(POOL_PROFILE_SLOTS - 1)
+
+// Home slot of ptr in the live block table
+static inline size_t pool_profile_slot(uintptr_t ptr)
+{
+	return (size_t)(((uint64_t)ptr * 0x9E3779B97F4A7C15ull) >> 32) & POOL_PROFILE_MASK;
+}
+
+static inline void pool_profile_lock(pool_profile_t* profile)
+{
+	while(__atomic_test_and_set(&profile->lock, __ATOMIC_ACQUIRE)) {
+	}
+}
+
+static inline void pool_profile_unlock(pool_profile_t* profile)
+{
+	__atomic_clear(&profile->lock, __ATOMIC_RELEASE);
+}
+
+void pool_profile_reset(pool_profile_t* profile)
+{
+	memset(profile, 0, sizeof(*profile));
+}
+
+void pool_profile_malloc(pool_profile_t* profile, const void* ptr, size_t n)
+{
+	size_t k = size_class_of(n);
+
+	pool_profile_lock(profile);
+	profile->requests[k]++;
+	profile->bytes[k] += n;
+
+	if(ptr && (profile->tracked < POOL_PROFILE_SLOTS / 4 * 3)) {
+		size_t slot = pool_profile_slot((uintptr_t)ptr);
+		while(profile->slot_ptrs[slot]) {
+			slot = (slot + 1) & POOL_PROFILE_MASK;
+		}
+		profile->slot_ptrs[slot] = (uintptr_t)ptr;
+		profile->slot_classes[slot] = (uint8_t)k;
+		profile->tracked++;
+
+		if(++profile->live[k] > profile->peak_live[k]) {
+			profile->peak_live[k] = profile->live[k];
+		}
+	}
+	else if(ptr) {
+		profile->untracked++;
+	}
+	pool_profile_unlock(profile);
+}
+
+void pool_profile_free(pool_profile_t* profile, const void* ptr)
+{
+	if(!ptr) {
+		return;
+	}
+
+	pool_profile_lock(profile);
+	size_t hole = pool_profile_slot((uintptr_t)ptr);
+	while(profile->slot_ptrs[hole] && (profile->slot_ptrs[hole] != (uintptr_t)ptr)) {
+		hole = (hole + 1) & POOL_PROFILE_MASK;
+	}
+
+	if(profile->slot_ptrs[hole]) {
+		profile->live[profile->slot_classes[hole]]--;
+		profile->tracked--;
+
+		// Close the gap: entries of the run whose home slot is not after
+		// the hole move back into it
+		for(size_t next = (hole + 1) & POOL_PROFILE_MASK; profile->slot_ptrs[next];
+		    next = (next + 1) & POOL_PROFILE_MASK) {
+			size_t home = pool_profile_slot(profile->slot_ptrs[next]);
+			if(((next - home) & POOL_PROFILE_MASK) >= ((next - hole) & POOL_PROFILE_MASK)) {
+				profile->slot_ptrs[hole] = profile->slot_ptrs[next];
+				profile->slot_classes[hole] = profile->slot_classes[next];
+				hole = next;
+			}
+		}
+		profile->slot_ptrs[hole] = 0;
+	}
+	pool_profile_unlock(profile);
+}
+
+void pool_profile_hook(const pool_event_t* event, void* ctx)
+{
+	switch(event->type) {
+		case POOL_EVENT_MALLOC:
+			pool_profile_malloc(ctx, event->ptr, event->size);
+			break;
+		case POOL_EVENT_MALLOC_FAILED:
+			pool_profile_malloc(ctx, NULL, event->size);
+			break;
+		case POOL_EVENT_FREE:
+			pool_profile_free(ctx, event->ptr);
+			break;
+		default:
+			break;
+	}
+}
+
+bool pool_profile_save(const pool_profile_t* profile, FILE* out)
+{
+	bool pass = fprintf(out, "pool_profile 1\nuntracked %zu\n", profile->untracked) >= 0;
+
+	for(size_t k = 0; pass && (k < SIZE_CLASS_COUNT); k++) {
+		if(profile->requests[k]) {
+			pass = fprintf(out, "%zu %zu %zu %zu\n", size_class_size(k), profile->requests[k],
+			               profile->bytes[k], profile->peak_live[k]) >= 0;
+		}
+	}
+	return pass && !fflush(out);
+}
+
+bool pool_profile_load(pool_profile_t* profile, FILE* in)
+{
+	pool_profile_reset(profile);
+
+	int version;
+	if((fscanf(in, " pool_profile %d untracked %zu", &version, &profile->untracked) != 2) || (version != 1)) {
+		return false;
+	}
+
+	size_t size, requests, bytes, peak_live;
+	int fields;
+	while((fields = fscanf(in, "%zu %zu %zu %zu", &size, &requests, &bytes, &peak_live)) == 4) {
+		if(!size || (size != size_class_size(size_class_of(size)))) {
+			return false;
+		}
+		size_t k = size_class_of(size);
+		profile->requests[k] += requests;
+		profile->bytes[k] += bytes;
+		if(peak_live > profile->peak_live[k]) {
+			profile->peak_live[k] = peak_live;
+		}
+	}
+	return fields == EOF;
+}
+
+
+/* Pool Tuning
+ *
+ * Requested classes are first merged by the smallest block size able to
+ * serve them, then split into contiguous groups by dynamic programming.
+*/
+typedef struct {
+	size_t block_size;
+	size_t peak;				// Sum of the peaks of the merged classes
+	size_t payload;				// Sum of their peaks times average request
+} pool_tune_class_t;
+
+// Smallest valid block size holding size class k, see pool_tune()
+static size_t pool_tune_block_size(size_t k, size_t align)
+{
+	if(size_class_size(k) < sizeof(pool_link_t)) {
+		k = size_class_of(sizeof(pool_link_t));
+	}
+	while(align && (size_class_size(k) >= align) && (size_class_size(k) % align) &&
+	      (size_class_size(k) != SIZE_MAX)) {
+		k++;
+	}
+	return size_class_size(k);
+}
+
+static inline size_t pool_tune_add(size_t a, size_t b)
+{
+	return (a > SIZE_MAX - b) ? SIZE_MAX : a + b;
+}
+
+static inline size_t pool_tune_mul(size_t a, size_t b)
+{
+	size_t product;
+	return __builtin_mul_overflow(a, b, &product) ? SIZE_MAX : product;
+}
+
+/* Scale the capacities of the pools of tuning to the heap, then trim
+ * them until the pools fit. needs are the peaks of the pools.
+ *
+ * Returns false if not even one block per pool fits.
+*/
+static bool pool_tune_fit(size_t heap_size, size_t page_size, const size_t* needs, pool_tuning_t* tuning)
+{
+	size_t num_pools = tuning->count;
+	size_t needed = 0;
+	for(size_t i = 0; i < num_pools; i++) {
+		needed = pool_tune_add(needed, pool_tune_mul(needs[i], tuning->block_sizes[i]));
+	}
+	bool keep_needs = needed <= heap_size;
+
+	// Leave room for each pool to end on a page
+	needed = pool_tune_add(needed, pool_tune_mul(num_pools, page_size));
+	for(size_t i = 0; i < num_pools; i++) {
+		unsigned __int128 scaled = (unsigned __int128)needs[i] * heap_size / needed;
+		size_t max_count = heap_size / tuning->block_sizes[i];
+		tuning->block_counts[i] = (scaled > max_count) ? max_count : (scaled ? (size_t)scaled : 1);
+	}
+
+	pool_config_t config = {0};
+	config.block_sizes = tuning->block_sizes;
+	config.block_size_count = num_pools;
+	config.pool_block_counts = tuning->block_counts;
+
+	pool_layout_t layout;
+	while(!pool_plan_layout(heap_size, &config, &layout)) {
+		size_t largest = num_pools;
+		for(size_t i = 0; i < num_pools; i++) {
+			size_t floor = keep_needs ? needs[i] : 1;
+			if((tuning->block_counts[i] > floor) &&
+			   ((largest == num_pools) || (tuning->block_counts[i] * tuning->block_sizes[i] >
+			                               tuning->block_counts[largest] * tuning->block_sizes[largest]))) {
+				largest = i;
+			}
+		}
+		if(largest == num_pools) {
+			if(!keep_needs) {
+				return false;
+			}
+			keep_needs = false;
+			continue;
+		}
+
+		size_t count = tuning->block_counts[largest];
+		size_t floor = keep_needs ? needs[largest] : 1;
+		size_t step = (count / 64) ? count / 64 : 1;
+		tuning->block_counts[largest] = (count - floor > step) ? count - step : floor;
+	}
+	tuning->heap_used = layout.ends[num_pools - 1] + tuning->block_sizes[num_pools - 1];
+
+	tuning->shortfall = 0;
+	for(size_t i = 0; i < num_pools; i++) {
+		if(needs[i] > tuning->block_counts[i]) {
+			tuning->shortfall += needs[i] - tuning->block_counts[i];
+		}
+	}
+	return true;
+}
+
+bool pool_tune(const pool_profile_t* profile, size_t heap_size, size_t align, pool_tuning_t* tuning)
+{
+	memset(tuning, 0, sizeof(*tuning));
+	if(!heap_size || (heap_size > POOL_MAX_HEAP_SIZE)) {
+		return false;
+	}
+
+	size_t max_block_size = heap_size / POOL_TUNE_MAX_BLOCK_SHARE;
+	size_t unfit = 0;
+	pool_tune_class_t classes[SIZE_CLASS_COUNT];
+	size_t class_count = 0;
+	for(size_t k = 0; k < SIZE_CLASS_COUNT; k++) {
+		if(!profile->requests[k]) {
+			continue;
+		}
+		size_t block_size = pool_tune_block_size(k, align);
+		if(block_size > max_block_size) {
+			unfit += profile->requests[k];
+			continue;
+		}
+		size_t average = profile->bytes[k] / profile->requests[k];
+		size_t payload = pool_tune_mul(profile->peak_live[k], (average < block_size) ? average : block_size);
+		if(!class_count || (classes[class_count - 1].block_size != block_size)) {
+			classes[class_count++] = (pool_tune_class_t){block_size, 0, 0};
+		}
+		classes[class_count - 1].peak = pool_tune_add(classes[class_count - 1].peak, profile->peak_live[k]);
+		classes[class_count - 1].payload = pool_tune_add(classes[class_count - 1].payload, payload);
+	}
+	if(!class_count) {
+		tuning->unfit = unfit;
+		return false;
+	}
+
+	size_t page_size = (size_t)1 << pool_owner_page_shift(heap_size, POOL_CACHE_LINE - 1);
+	size_t padding = POOL_CACHE_LINE;	// Breaks ties towards fewer pools
+	size_t peaks[SIZE_CLASS_COUNT + 1] = {0};
+	size_t payloads[SIZE_CLASS_COUNT + 1] = {0};
+	for(size_t j = 0; j < class_count; j++) {
+		peaks[j + 1] = pool_tune_add(peaks[j], classes[j].peak);
+		payloads[j + 1] = pool_tune_add(payloads[j], classes[j].payload);
+	}
+
+	// costs[p][j]: least waste of the first j classes in p pools, plus a
+	// line per pool, the last of which starts at class splits[p][j]. Page
+	// padding only counts once the pools are fitted to the heap.
+	size_t costs[MAX_POOLS + 1][SIZE_CLASS_COUNT + 1];
+	uint8_t splits[MAX_POOLS + 1][SIZE_CLASS_COUNT + 1];
+	for(size_t j = 0; j <= class_count; j++) {
+		costs[0][j] = j ? SIZE_MAX : 0;
+	}
+	for(size_t p = 1; p <= MAX_POOLS; p++) {
+		for(size_t j = 0; j <= class_count; j++) {
+			costs[p][j] = SIZE_MAX;
+			for(size_t i = p - 1; i < j; i++) {
+				size_t bytes = pool_tune_mul(classes[j - 1].block_size, peaks[j] - peaks[i]);
+				size_t payload = payloads[j] - payloads[i];
+				size_t waste = (bytes > payload) ? bytes - payload : 0;
+				size_t cost = pool_tune_add(costs[p - 1][i], pool_tune_add(waste, padding));
+				if(cost < costs[p][j]) {
+					costs[p][j] = cost;
+					splits[p][j] = (uint8_t)i;
+				}
+			}
+		}
+	}
+
+	// Power of 2 pool counts only, by the least cost once fitted to the
+	// heap, the fewest pools on ties
+	static const size_t pool_counts[] = {1, 2, 4, 8, 16};
+	size_t best_cost = SIZE_MAX;
+	for(size_t c = 0; c < sizeof(pool_counts) / sizeof(pool_counts[0]); c++) {
+		size_t num_pools = pool_counts[c];
+		if((num_pools > MAX_POOLS) || (num_pools > class_count)) {
+			break;
+		}
+
+		pool_tuning_t candidate = {0};
+		size_t needs[MAX_POOLS];
+		for(size_t p = num_pools, j = class_count; p > 0; j = splits[p][j], p--) {
+			size_t peak = peaks[j] - peaks[splits[p][j]];
+			candidate.block_sizes[p - 1] = classes[j - 1].block_size;
+			needs[p - 1] = peak ? peak : 1;
+		}
+		candidate.count = num_pools;
+		if(!pool_tune_fit(heap_size, page_size, needs, &candidate)) {
+			continue;
+		}
+
+		// Blocks short at peak are served elsewhere, a cost in full
+		size_t cost = costs[num_pools][class_count];
+		for(size_t i = 0; i < num_pools; i++) {
+			if(needs[i] > candidate.block_counts[i]) {
+				cost = pool_tune_add(cost, pool_tune_mul(needs[i] - candidate.block_counts[i], candidate.block_sizes[i]));
+			}
+		}
+		if(cost < best_cost) {
+			best_cost = cost;
+			*tuning = candidate;
+		}
+	}
+	tuning->unfit = unfit;
+	if(!tuning->count) {
+		return false;
+	}
+
+	// Bytes of each class's peak blocks beyond its average request
+	for(size_t k = 0, i = 0; k < SIZE_CLASS_COUNT; k++) {
+		size_t block_size = pool_tune_block_size(k, align);
+		if(!profile->requests[k] || (block_size > max_block_size)) {
+			continue;
+		}
+		while(tuning->block_sizes[i] < block_size) {
+			i++;
+		}
+		size_t average = profile->bytes[k] / profile->requests[k];
+		tuning->waste = pool_tune_add(tuning->waste, pool_tune_mul(profile->peak_live[k], tuning->block_sizes[i] - average));
+	}
+	return true;
+}
+
+#ifndef POOL_LIBRARY
+int main() {
+	TestRunner();
+	return 0; 
+}
+#endif
\ No newline at end of file
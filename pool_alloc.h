@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
@@ -7,31 +8,584 @@
 #ifndef POOL_ALLOC_H
 #define POOL_ALLOC_H
 
+/* C++ compatibility
+ *
+ * C11 keywords are spelled through these macros so that the header can
+ * also be included from C++ (see pool_alloc.hpp).
+ */
+#ifdef __cplusplus
+#define POOL_STATIC_ASSERT(cond, msg)	static_assert(cond, msg)
+#define POOL_ALIGNAS(n)					alignas(n)
+#define POOL_ATOMIC(type)				std::atomic<type>
+#else
+#define POOL_STATIC_ASSERT(cond, msg)	_Static_assert(cond, msg)
+#define POOL_ALIGNAS(n)					_Alignas(n)
+#define POOL_ATOMIC(type)				_Atomic type
+#endif
+
+#ifndef HEAP_SIZE
 #define HEAP_SIZE 	65536
+#endif
 #define MAX_POOLS	16
 
+/* Free list link width
+ *
+ * A free block stores the heap index of the next free block in a link
+ * of POOL_LINK_BITS bits. This bounds every heap (g_pool_heap and
+ * pool_create() instances alike) to POOL_MAX_HEAP_SIZE bytes and every
+ * block to at least sizeof(pool_link_t) bytes.
+ *
+ * Defaults to the narrowest width able to index HEAP_SIZE, so small
+ * heaps keep 2-byte links. Set it to 32 or 64 for larger instances.
+ */
+#ifndef POOL_LINK_BITS
+#if HEAP_SIZE <= 65536
+#define POOL_LINK_BITS		16
+#elif HEAP_SIZE <= 4294967296
+#define POOL_LINK_BITS		32
+#else
+#define POOL_LINK_BITS		64
+#endif
+#endif
+
+#if POOL_LINK_BITS == 16
+typedef uint16_t pool_link_t;
+#define POOL_MAX_HEAP_SIZE	((size_t)1 << 16)
+#elif POOL_LINK_BITS == 32
+typedef uint32_t pool_link_t;
+#define POOL_MAX_HEAP_SIZE	((size_t)1 << 32)
+#elif POOL_LINK_BITS == 64
+typedef uint64_t pool_link_t;
+#define POOL_MAX_HEAP_SIZE	SIZE_MAX
+#else
+#error "POOL_LINK_BITS must be 16, 32 or 64"
+#endif
+
+POOL_STATIC_ASSERT(HEAP_SIZE <= POOL_MAX_HEAP_SIZE, "HEAP_SIZE exceeds POOL_LINK_BITS");
+
+// Entries of the owner map of non-uniform pools, see pool_controller_t
+#ifndef POOL_OWNER_MAP_SIZE
+#define POOL_OWNER_MAP_SIZE	1024
+#endif
+
+// Growth slabs an allocator can hold at once, see pool_config_t
+#ifndef POOL_MAX_SLABS
+#define POOL_MAX_SLABS		16
+#endif
+
+/* Size classes
+ *
+ * Requests are classed in four steps per power of 2. Class k holds up
+ * to 1, 2, 3, 4, 5, 6, 7, 8, 10, 12, 14, 16, 20, 24, 28, 32, 40, ...
+ * bytes, i.e. up to every size with at most 3 significant bits. Block
+ * sizes must be one of these class sizes, see pool_init().
+ */
+#define SIZE_CLASS_COUNT	(4 * (sizeof(size_t) * 8 - 1))
+
+// One alignment class per power of 2 a size_t can hold
+#define ALIGN_CLASS_COUNT	(sizeof(size_t) * 8)
+
+POOL_STATIC_ASSERT(MAX_POOLS < 32, "pool_available is a 32-bit mask");
+POOL_STATIC_ASSERT(POOL_MAX_SLABS > 0 && POOL_MAX_SLABS < 32, "slab_used is a 32-bit mask");
+
+/* Compile-time trace level for allocator events
+ *
+ * 0: no tracing, pool_malloc() and pool_free() perform no I/O or calls
+ * 1: failures only (POOL_EVENT_MALLOC_FAILED)
+ * 2: every event
+ *
+ * Events are delivered to the hook set by pool_set_event_hook().
+ */
+#ifndef POOL_TRACE_LEVEL
+#define POOL_TRACE_LEVEL	0
+#endif
+
+/* Debug checks
+ *
+ * When POOL_DEBUG is 1, API contracts that are otherwise assumed, such
+ * as the size passed to pool_free_sized(), are checked with assert().
+ */
+#ifndef POOL_DEBUG
+#define POOL_DEBUG			0
+#endif
+
+#define POOL_CACHE_LINE		64
+
+// Alignment of g_pool_heap, and largest page_size accepted by pool_init_ex()
+#ifndef POOL_PAGE_SIZE
+#define POOL_PAGE_SIZE		4096
+#endif
+
+// Granularity of POOL_MAP_HUGETLB mappings
+#ifndef POOL_HUGE_PAGE_SIZE
+#define POOL_HUGE_PAGE_SIZE	((size_t)2 << 20)
+#endif
+
+// NUMA arenas pool_numa_init() can create, see NUMA Arenas
+#ifndef POOL_NUMA_MAX_NODES
+#define POOL_NUMA_MAX_NODES	16
+#endif
+
+// Allocations between two lookups of the calling thread's NUMA node
+#ifndef POOL_NUMA_REFRESH
+#define POOL_NUMA_REFRESH	256
+#endif
+
+// Free list link marking the last free block of a pool
+#define POOL_NULL_LINK		((pool_link_t)-1)
+
+/* Thread-safe mode
+ *
+ * When POOL_THREAD_SAFE is 1, every thread keeps a magazine of up to
+ * POOL_TCACHE_SIZE free blocks per pool. pool_malloc() and pool_free()
+ * only touch the calling thread's magazines, and the shared pools are
+ * locked once per POOL_TCACHE_BATCH blocks to refill or flush them.
+ * Requires linking with -pthread.
+ */
+#ifndef POOL_THREAD_SAFE
+#define POOL_THREAD_SAFE	0
+#endif
+
+#if POOL_THREAD_SAFE
+#include <pthread.h>
+
+#ifndef POOL_TCACHE_SIZE
+#define POOL_TCACHE_SIZE	32
+#endif
+#ifndef POOL_TCACHE_BATCH
+#define POOL_TCACHE_BATCH	(POOL_TCACHE_SIZE / 2)
+#endif
+#ifndef POOL_TCACHE_INSTANCES
+#define POOL_TCACHE_INSTANCES	4	// Allocators a thread caches at once
+#endif
+
+POOL_STATIC_ASSERT(POOL_TCACHE_BATCH > 0 && POOL_TCACHE_BATCH <= POOL_TCACHE_SIZE,
+               "magazine batch must fit in a magazine");
+#endif
+
+/* Lock-free mode
+ *
+ * When POOL_LOCK_FREE is 1, each pool's free list head is a tagged word
+ * updated with compare-and-swap, so any thread can allocate from or free
+ * to any pool without locks. The tag is bumped on every update so a head
+ * that was popped and pushed back in between (ABA) fails the swap.
+ * Alternative to POOL_THREAD_SAFE, the two cannot be combined.
+ */
+#ifndef POOL_LOCK_FREE
+#define POOL_LOCK_FREE		0
+#endif
+
+#if POOL_LOCK_FREE
+#if POOL_THREAD_SAFE
+#error "POOL_LOCK_FREE and POOL_THREAD_SAFE are alternative modes"
+#endif
+#if POOL_LINK_BITS > 32
+#error "POOL_LOCK_FREE packs links into 32 bits of the tagged head"
+#endif
+#ifdef __cplusplus
+#include <atomic>
+#else
+#include <stdatomic.h>
+#endif
+
+// Tagged free list head: block index in the low word, tag in the high word
+#define POOL_HEAD(index, tag)	(((uint64_t)(tag) << 32) | (uint32_t)(index))
+#define POOL_HEAD_INDEX(head)	((uint32_t)(head))
+#define POOL_HEAD_TAG(head)		((uint32_t)((head) >> 32))
+#endif
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	POOL_OWNER_SHIFT,
+	POOL_OWNER_DIVIDE,
+	POOL_OWNER_MAP
+} pool_owner_lookup_t;
+
+
+/* Spill Policy
+ *
+ * Which larger pools may serve a request whose best fitting pool is full.
+*/
+typedef enum {
+	POOL_SPILL_ANY,		// Any pool with larger blocks, the default
+	POOL_SPILL_NEXT,	// Only the pool with the next larger blocks
+	POOL_SPILL_NONE		// None, the allocation fails instead
+} pool_spill_t;
+
+
+/* Rebalance Policy
+ *
+ * When a growth slab whose blocks are all free goes back to its source,
+ * where other size classes can take it. See pool_config_t.
+*/
+typedef enum {
+	POOL_REBALANCE_TRIM,	// On pool_trim() only, the default
+	POOL_REBALANCE_EAGER,	// As soon as its last block is freed
+	POOL_REBALANCE_SPARE	// Same, unless no other slab of its pool has a free block
+} pool_rebalance_t;
+
+
+/* Growth Slab
+ *
+ * Memory acquired for one pool after its share of the heap ran out.
+ * Free blocks are linked by their offset from base, the same way heap
+ * blocks are linked by their heap index.
+*/
+typedef struct {
+	uint8_t* base;
+	uint8_t pool_idx;
+	pool_link_t free;				// First free block, POOL_NULL_LINK if none
+	size_t bump;					// Offset of the first never-used block
+	size_t used;					// Blocks handed out
+} pool_slab_t;
+
+// Sources of growth slabs, see pool_config_t
+typedef void* (*pool_slab_acquire_t)(size_t size, void* ctx);
+typedef void (*pool_slab_release_t)(void* slab, size_t size, void* ctx);
+
 
 /* Pool Controller
  *
- * Used as a global object to track the state of the heap. 
+ * Tracks the state of one heap. The global pool_controller manages
+ * g_pool_heap, further instances are created with pool_create().
  * Its size is limited by the MAX_POOLS assumpion described in
  * the pool_init() docstring
  *
 */
 typedef struct {
+	uint8_t* heap;					// Memory managed by this controller
+	size_t heap_size;
+
 	uint8_t num_pools;				// Used to track heap parameters
 	size_t block_sizes[MAX_POOLS];  // Used to track heap parameters
 	
-	uint16_t pool_begin_indices[MAX_POOLS];
-	uint32_t pool_end_indices[MAX_POOLS];
-	
-	bool pool_full[MAX_POOLS]; 
-	uint16_t pool_allocators[MAX_POOLS];  // Holds pool allocator idx in g_pool_heap
+	pool_link_t pool_begin_indices[MAX_POOLS];
+	pool_link_t pool_end_indices[MAX_POOLS];
+
+	/* Size class lookup used by pool_malloc()
+	 *
+	 * size_class_pools[k] has bit i set when pool i can hold every size
+	 * of class k, so the first pool able to serve n bytes is the lowest
+	 * set bit of pool_available & size_class_pools[class of n].
+	 */
+	uint32_t size_class_pools[SIZE_CLASS_COUNT];
+
+	// align_pools[k] has bit i set when every block of pool i is aligned
+	// to 2^k bytes, see pool_aligned_malloc()
+	uint32_t align_pools[ALIGN_CLASS_COUNT];
+	pool_spill_t spill;				// Already applied to size_class_pools
+
+	/* Owning pool lookup used by pool_free()
+	 *
+	 * When pools are evenly sized, the pool of a heap index is
+	 * idx >> pool_size_shift when pool_size is a power of 2,
+	 * and idx / pool_size otherwise.
+	 *
+	 * Pools sized by weights or block counts (see pool_config_t) start
+	 * on boundaries of 2^owner_map_shift byte pages instead, and the
+	 * pool of a heap index is owner_map[idx >> owner_map_shift].
+	 */
+	pool_owner_lookup_t owner_lookup;
+	size_t pool_size;				// 0 when pools are not evenly sized
+	uint8_t pool_size_shift;
+	uint8_t owner_map_shift;
+	uint8_t owner_map[POOL_OWNER_MAP_SIZE];
+
+	uint32_t init_generation;  // Renewed by each init, invalidates thread caches
+	size_t bound_tcaches;      // Thread caches bound to the instance, POOL_DEBUG only
+
+	// Growth slab source, slab_acquire is NULL when growth is disabled
+	pool_slab_acquire_t slab_acquire;
+	pool_slab_release_t slab_release;
+	void* slab_ctx;
+	size_t slab_size;
+	pool_rebalance_t rebalance;
+	size_t reserve_begin;			// Heap index of the slab reserve, heap_size if none
+
+	/* Occupancy bitmaps, see pool_config_t
+	 *
+	 * Pool i's bitmap starts bitmap_offsets[i] words into the words at
+	 * heap index bitmap_begin. Bit j is set while block j is in use, and
+	 * for the bits past the last block.
+	 */
+	bool bitmap;
+	size_t bitmap_begin;
+	size_t bitmap_offsets[MAX_POOLS];
+
+	void* mapping;					// Set by pool_map(), NULL otherwise
+	size_t mapping_size;
+
+	/* Mutable pool state
+	 *
+	 * Starts on its own cache line so that threads reading the
+	 * configuration above do not contend with allocations.
+	 * pool_available has bit i set while pool i still has a free block.
+	 *
+	 * In POOL_LOCK_FREE builds the free lists are headed by pool_heads
+	 * instead, and pool_full, pool_allocators and pool_available only
+	 * reflect the state left by pool_init().
+	 */
+	POOL_ALIGNAS(POOL_CACHE_LINE) bool pool_full[MAX_POOLS]; 
+	pool_link_t pool_allocators[MAX_POOLS];  // Holds pool allocator idx in heap
+	uint32_t pool_available;
+
+	// Heap index of the first never-used block of each lazy pool
+#if POOL_LOCK_FREE
+	POOL_ATOMIC(size_t) pool_bumps[MAX_POOLS];
+#else
+	size_t pool_bumps[MAX_POOLS];
+#endif
+#if POOL_LOCK_FREE
+	POOL_ATOMIC(uint64_t) pool_heads[MAX_POOLS];  // POOL_HEAD(allocator idx, tag)
+#endif
+
+	/* Spill accounting, indexed by the best fitting pool of the request
+	 *
+	 * spill_counts[i] counts allocations served by a larger pool because
+	 * pool i was full. spill_bytes[i] sums the internal fragmentation
+	 * those spills added, i.e. the difference between the block handed
+	 * out and a block of pool i. Reset by each init.
+	 */
+	size_t spill_counts[MAX_POOLS];
+	size_t spill_bytes[MAX_POOLS];
+
+	/* Usage accounting, see pool_get_stats()
+	 *
+	 * alloc_counts[i] and free_counts[i] count blocks of pool i handed
+	 * out and returned, high_water[i] the most of them in use at once.
+	 * fail_counts[i] counts failed requests of best fitting pool i, and
+	 * unfit_count requests no pool could ever hold. Reset by each init.
+	 */
+	size_t alloc_counts[MAX_POOLS];
+	size_t free_counts[MAX_POOLS];
+	size_t high_water[MAX_POOLS];
+	size_t fail_counts[MAX_POOLS];
+	size_t unfit_count;
+
+	/* Growth slabs
+	 *
+	 * slab_used has bit s set while slabs[s] holds memory, and
+	 * slab_available while it also has a free block. pool_slabs[i] has
+	 * bit s set while slabs[s] belongs to pool i.
+	 */
+	pool_slab_t slabs[POOL_MAX_SLABS];
+	uint32_t slab_used;
+	uint32_t slab_available;
+	uint32_t pool_slabs[MAX_POOLS];
+	uint32_t reserve_free;			// Bit s set while reserve slab s is free
+
+	// First bitmap word of each pool that may have a clear bit, and the
+	// clear bits left
+	size_t bitmap_hints[MAX_POOLS];
+	size_t bitmap_free[MAX_POOLS];
+	size_t double_free_count;
+#if POOL_THREAD_SAFE
+	pthread_mutex_t lock;
+#endif
 } pool_controller_t; 
 
+// Allocator instance handle, see pool_create()
+typedef pool_controller_t pool_allocator_t;
+
+
+/* Pool Configuration
+ *
+ * Extended inputs of pool_init_ex() and pool_create_ex(). Fields left
+ * zero keep the behaviour of pool_init() and pool_create().
+*/
+typedef struct {
+	const size_t* block_sizes;		// As passed to pool_init()
+	size_t block_size_count;
+
+	/* Link blocks into the free lists only once they are freed. Pools
+	 * hand out never-used blocks from a bump index when their free list
+	 * is empty, so initialization does not touch the heap at all.
+	 */
+	bool lazy;
+
+	/* Non-uniform pool sizing, at most one of the two may be set.
+	 *
+	 * pool_weights[i] is the relative share of the heap given to pool i.
+	 * pool_block_counts[i] is the exact number of blocks in pool i, the
+	 * part of the heap not needed by any pool is left unused.
+	 *
+	 * Pools then start on owner map page boundaries, which may leave up
+	 * to a page (heap size / POOL_OWNER_MAP_SIZE) unused per pool.
+	 */
+	const size_t* pool_weights;
+	const size_t* pool_block_counts;
 
-static uint8_t g_pool_heap[HEAP_SIZE];
-static pool_controller_t pool_controller; 
+	pool_spill_t spill;
+
+	/* Growth, disabled while slab_acquire is NULL.
+	 *
+	 * When the best fitting pool of a request is exhausted, it grows by a
+	 * slab_size byte slab from slab_acquire(slab_size, slab_ctx) before
+	 * the request spills to a larger pool. At most POOL_MAX_SLABS slabs
+	 * are held at once, and pool_trim() hands the empty ones back to
+	 * slab_release(). slab_size must fit the largest block and cannot
+	 * exceed POOL_MAX_HEAP_SIZE.
+	 *
+	 * Slabs must be aligned to a cache line. See pool_slab_acquire_parent()
+	 * and pool_slab_acquire_mmap() for ready-made sources. Not available
+	 * in POOL_LOCK_FREE builds.
+	 */
+	pool_slab_acquire_t slab_acquire;
+	pool_slab_release_t slab_release;
+	void* slab_ctx;
+	size_t slab_size;
+
+	/* Rebalancing between size classes
+	 *
+	 * The last reserve_size bytes of the heap are carved into slab_size
+	 * byte slabs instead of pools. They are the growth slabs of whichever
+	 * pool runs out, in place of slab_acquire (which must then be NULL),
+	 * and go back to the reserve once their blocks are all free, as
+	 * decided by rebalance, to serve any size class again.
+	 *
+	 * slab_size must be a multiple of a cache line, and reserve_size a
+	 * multiple of slab_size of at most POOL_MAX_SLABS slabs. rebalance
+	 * also applies to slabs of other sources.
+	 */
+	size_t reserve_size;
+	pool_rebalance_t rebalance;
+
+	/* Track the free blocks of each pool in an occupancy bitmap instead
+	 * of free lists linked through the blocks.
+	 *
+	 * The bitmaps take the end of the heap, a bit per block. Blocks are
+	 * handed out lowest address first, can be as small as 1 byte, and
+	 * are never written by the allocator. A free of a block that is
+	 * already free is counted (see pool_stats_t) and ignored, once the
+	 * block reaches the shared pool in POOL_THREAD_SAFE builds. Enables
+	 * pool_visit_live().
+	 *
+	 * Not available with growth slabs or in POOL_LOCK_FREE builds.
+	 */
+	bool bitmap;
+
+	/* Start the heap and every pool on a page_size boundary, a power of
+	 * 2. Evenly sized pools shrink to a multiple of page_size.
+	 */
+	size_t page_size;
+} pool_config_t;
+
+
+/* Size class of n, see SIZE_CLASS_COUNT. Sizes 0 and 1 both map to
+ * class 0.
+ *
+ * Beyond 4 bytes, class 4 * (e - 1) + m holds the sizes above
+ * (4 + m) << (e - 2), where e = floor(log2(n - 1)) and m are the two
+ * bits of n - 1 below its leading one.
+*/
+static inline size_t size_class_of(size_t n) {
+	if(n <= 4) {
+		return n ? n - 1 : 0;
+	}
+	size_t e = sizeof(unsigned long long) * 8 - 1 - __builtin_clzll(n - 1);
+	return 4 * (e - 1) + (((n - 1) >> (e - 2)) & 3);
+}
+
+/* Largest size of class k. Saturates at SIZE_MAX for the last class.
+*/
+static inline size_t size_class_size(size_t k) {
+	if(k < 4) {
+		return k + 1;
+	}
+	unsigned __int128 size = (unsigned __int128)(5 + k % 4) << (k / 4 - 1);
+	return (size > SIZE_MAX) ? SIZE_MAX : (size_t)size;
+}
+
+
+/* Pool Statistics
+ *
+ * Snapshot of an allocator filled by pool_get_stats(). Blocks count as
+ * in use from the time pool_malloc() hands them out until they are
+ * passed to pool_free(), wherever they are cached in between.
+*/
+typedef struct {
+	size_t block_size;
+	size_t blocks;				// Heap blocks plus those of held growth slabs
+	size_t in_use;
+	size_t high_water;			// Most blocks in use at once since init
+	size_t allocs;
+	size_t frees;
+	size_t failures;			// Requests of this best fitting pool that failed
+	size_t spills;				// As spill_counts in pool_controller_t
+	size_t spill_bytes;
+	size_t slabs;				// Growth slabs held
+} pool_usage_t;
+
+typedef struct {
+	size_t heap_size;
+	size_t num_pools;
+	size_t unfit;				// Requests larger than every pool's blocks
+	size_t reserve_free;		// Reserve slabs held by no pool, see pool_config_t
+	size_t double_frees;		// Frees of free blocks, with bitmaps only
+	pool_usage_t pools[MAX_POOLS];
+} pool_stats_t;
+
+
+extern uint8_t g_pool_heap[HEAP_SIZE];
+extern pool_controller_t pool_controller; 
+
+
+/* Free list link stored in the block at heap[idx]
+*/
+static inline pool_link_t pool_link_read(const uint8_t* heap, size_t idx) {
+	pool_link_t link;
+	memcpy(&link, &heap[idx], sizeof(link));
+	return link;
+}
+
+static inline void pool_link_write(uint8_t* heap, size_t idx, pool_link_t link) {
+	memcpy(&heap[idx], &link, sizeof(link));
+}
+
+
+/* Allocator Events
+ *
+ * Structured replacement for printing from the allocation path. The hook
+ * is called synchronously from pool_malloc()/pool_free() and must not
+ * call back into the allocator.
+*/
+typedef enum {
+	POOL_EVENT_MALLOC,			// Block handed out from pool_idx
+	POOL_EVENT_FREE,			// Block returned to pool_idx
+	POOL_EVENT_POOL_FULL,		// Last free block of pool_idx handed out
+	POOL_EVENT_MALLOC_FAILED,	// No pool could hold size bytes
+	POOL_EVENT_SLAB_ACQUIRED,	// Slab of size bytes added to pool_idx
+	POOL_EVENT_SLAB_RELEASED	// Slab of size bytes returned by pool_idx
+} pool_event_type_t;
+
+typedef struct {
+	pool_event_type_t type;
+	uint8_t pool_idx;
+	size_t size;
+	void* ptr;
+} pool_event_t;
+
+typedef void (*pool_event_hook_t)(const pool_event_t* event, void* ctx);
+
+
+/* Set the hook receiving allocator events, NULL disables it.
+ * Has no effect when POOL_TRACE_LEVEL is 0.
+ *
+ * The hook and ctx are published together, so threads allocating
+ * meanwhile call either the old hook with the old ctx or the new pair.
+ * A hook may still run once pool_set_event_hook() has returned. Calls
+ * to pool_set_event_hook() itself must not run concurrently.
+*/
+void pool_set_event_hook(pool_event_hook_t hook, void* ctx);
+
+
+/* DEBUG hook printing events to stdout, ctx is unused
+*/
+void pool_trace_stdio(const pool_event_t* event, void* ctx);
 
 
 /* DEBUG function for printing the heap at <idx +/- padding>
@@ -40,12 +594,32 @@ void print_heap_range(size_t idx, size_t padding);
 
 
 /* Helper function to validate inputs for heap configuration
+ *
+ * Block sizes must be unique class sizes (see pool_init()) in
+ * ascending order, of at least sizeof(pool_link_t) bytes, and fit in
+ * their pool.
  *
  * Returns true for valid inputs, false otherwise
  */
 bool verify_heap_inputs(const size_t* block_sizes, size_t block_size_count);
 
 
+/* Same as verify_heap_inputs(), for a heap of heap_size bytes.
+ * heap_size cannot exceed POOL_MAX_HEAP_SIZE.
+ */
+bool verify_pool_inputs(size_t heap_size, const size_t* block_sizes, size_t block_size_count);
+
+
+/* Same as verify_pool_inputs(), for an extended configuration.
+ *
+ * With weights, every pool's share must hold at least one block.
+ * With block counts, every count must be non-zero and all pools must
+ * fit in the heap together. With bitmaps, blocks may be smaller than
+ * sizeof(pool_link_t).
+ */
+bool verify_pool_config(size_t heap_size, const pool_config_t* config);
+
+
 /* Initialize the pool allocator with a set of block sizes appropriate
  * for this application.
  *
@@ -59,9 +633,15 @@ bool verify_heap_inputs(const size_t* block_sizes, size_t block_size_count);
  *
  * Input Assumptions:
  
- * 1. Provided block sizes are powers of 2.
+ * 1. Provided block sizes are class sizes (see SIZE_CLASS_COUNT),
+ *    i.e. powers of 2 or one, two or three quarters between two
+ *    powers of 2, such as 48, 80, 96 and 112.
+ *
+ * 2. Block sizes are provided in strictly ascending order
  *
- * 2. Block sizes are provided in ascending order
+ *    Block sizes must be at least sizeof(pool_link_t) bytes,
+ *    since free blocks store a link to the next free block
+ *    (unless they are tracked by bitmaps, see pool_config_t).
  *
  * 3. block_size_count must be a power of 2, up to 2^4.
  *    This is because splitting the heap into 16 pools 
@@ -80,18 +660,55 @@ bool verify_heap_inputs(const size_t* block_sizes, size_t block_size_count);
  *    memory by limiting the size of the arrays in 
  *    the Pool Controller.
  *
+ * Thread Safety:
+ *
+ * pool_init() must not run concurrently with any other pool call.
+ * Blocks cached by threads before a re-initialization are discarded.
+ *
 */
 bool pool_init(const size_t* block_sizes, size_t block_size_count);
 
 
+/* pool_init() with extended configuration, see pool_config_t
+*/
+bool pool_init_ex(const pool_config_t* config);
+
+
 /* Allocate n bytes.
+ *
+ * The pool is selected in constant time through the size class table
+ * built by pool_init(). When the best fitting pool is full, it grows
+ * by a slab if growth is configured. Otherwise the next
+ * pool (in pool_init() order) with large enough blocks is used instead,
+ * as far as the configured pool_spill_t allows. Such spills are counted
+ * in spill_counts and spill_bytes.
+ *
+ * Blocks are aligned to the largest power of 2 dividing their block
+ * size, up to a cache line (POOL_CACHE_LINE). Power of 2 blocks of 64
+ * bytes or more are thus aligned to a cache line and smaller ones to
+ * their own size, while 48 byte blocks are aligned to 16 bytes.
  *
  * Returns pointer to allocated memory on success, NULL on failure.
 */ 
 void* pool_malloc(size_t n);
 
 
+/* Allocate n bytes aligned to align, a power of 2.
+ *
+ * Served by the smallest pool able to hold max(n, align) bytes at that
+ * alignment, then spills like pool_malloc(). Alignments beyond a cache
+ * line are met by pools whose placement happens to satisfy them, such
+ * as pools of page aligned heaps (see pool_config_t.page_size).
+ *
+ * Returns pointer to allocated memory on success, NULL on failure or if
+ * align is not a power of 2. Released with pool_free().
+*/
+void* pool_aligned_malloc(size_t n, size_t align);
+
+
 /* Release allocation pointed to by ptr.
+ *
+ * The owning pool is derived from the address in constant time.
  *
  * Assumptions:
  * 1. Argument must match a pointer earlier returned by a call
@@ -106,4 +723,396 @@ void* pool_malloc(size_t n);
 void pool_free(void* ptr);
 
 
+/* Allocate count blocks of n bytes each, storing them in out.
+ *
+ * Blocks are taken from the best fitting pool as one chain (under one
+ * lock or swap in threaded builds), then block by block with the growth
+ * and spill rules of pool_malloc() once that pool runs out.
+ *
+ * Returns the number of blocks allocated, out[0..count) is only filled
+ * up to it.
+*/
+size_t pool_malloc_bulk(size_t n, size_t count, void** out);
+
+
+/* Release count allocations, NULL entries are skipped.
+ *
+ * Blocks go straight back to their pools, under one lock in
+ * POOL_THREAD_SAFE builds and one swap per pool in POOL_LOCK_FREE builds.
+*/
+void pool_free_bulk(void** ptrs, size_t count);
+
+
+/* Release allocation pointed to by ptr, of n bytes as requested from
+ * pool_malloc().
+ *
+ * The pool is derived from n through the size class table instead of
+ * from the address. A block that spilled to a larger pool falls back to
+ * pool_free(). POOL_DEBUG builds check that such a block can hold n.
+*/
+void pool_free_sized(void* ptr, size_t n);
+
+
+/* Resize the allocation pointed to by ptr to n bytes.
+ *
+ * The block is kept, and the same pointer returned, while n fits in it
+ * and no smaller pool could hold n. Otherwise the contents move to a
+ * block of the best fitting pool for n, as allocated by pool_malloc().
+ * Shrinking blocks stay in place when that allocation fails.
+ *
+ * Behaves as pool_malloc(n) when ptr is NULL and as pool_free(ptr) when
+ * n is 0, returning NULL. Returns NULL and leaves ptr untouched if the
+ * block cannot grow.
+*/
+void* pool_realloc(void* ptr, size_t n);
+
+
+/* Bytes usable in the allocation pointed to by ptr, i.e. the block size
+ * of its pool. Returns 0 for NULL and for memory outside the allocator.
+*/
+size_t pool_usable_size(const void* ptr);
+
+
+/* Create an allocator instance over caller-supplied memory.
+ *
+ * The instance state is placed at the start of buffer and the rest of
+ * it (up to POOL_MAX_HEAP_SIZE bytes) is split into pools exactly like
+ * pool_init() splits g_pool_heap, under the same input assumptions.
+ * Instances are independent of each other and of the global heap.
+ *
+ * Returns the instance on success, NULL if the inputs are invalid or
+ * the buffer is too small.
+ *
+ * In POOL_THREAD_SAFE builds, threads cache blocks of the instances
+ * they use. The buffer must not be released or reused until every such
+ * thread has exited or called pool_thread_cache_flush().
+*/
+pool_allocator_t* pool_create(void* buffer, size_t size,
+                              const size_t* block_sizes, size_t block_size_count);
+
+
+/* pool_create() with extended configuration, see pool_config_t
+*/
+pool_allocator_t* pool_create_ex(void* buffer, size_t size, const pool_config_t* config);
+
+
+/* Create an allocator instance over a new anonymous mapping with a
+ * heap of size bytes, page aligned (see pool_config_t.page_size, which
+ * defaults to the system page size here).
+ *
+ * flags is a combination of:
+ * POOL_MAP_HUGETLB:  back the mapping with explicit huge pages, falling
+ *                    back to normal pages if none are available.
+ * POOL_MAP_HUGEPAGE: advise transparent huge pages for the mapping.
+ * POOL_MAP_NODE(n):  bind the mapping to NUMA node n (mbind) before any
+ *                    page of it is touched. Best effort, like
+ *                    POOL_MAP_HUGEPAGE, and n must be below 256.
+ *
+ * pool_trim() returns the pages of unused pools of such an instance to
+ * the system. pool_destroy() unmaps it.
+*/
+#define POOL_MAP_HUGETLB	0x1u
+#define POOL_MAP_HUGEPAGE	0x2u
+#define POOL_MAP_BIND		0x4u
+#define POOL_MAP_NODE(n)	(POOL_MAP_BIND | ((unsigned)(n) & 0xffu) << 8)
+pool_allocator_t* pool_map(size_t size, const pool_config_t* config, unsigned flags);
+
+
+/* Release resources held by an instance (not its buffer), including
+ * all of its growth slabs.
+ *
+ * In POOL_THREAD_SAFE builds, the calling thread's caches of pool are
+ * discarded, but every other thread that used pool must have exited or
+ * called pool_thread_cache_flush() first. Otherwise its caches would
+ * later flush into a released instance. POOL_DEBUG builds assert this.
+*/
+void pool_destroy(pool_allocator_t* pool);
+
+
+/* pool_malloc() and pool_free() for a given instance
+*/
+void* pool_malloc_from(pool_allocator_t* pool, size_t n);
+void pool_free_to(pool_allocator_t* pool, void* ptr);
+void* pool_aligned_malloc_from(pool_allocator_t* pool, size_t n, size_t align);
+size_t pool_malloc_bulk_from(pool_allocator_t* pool, size_t n, size_t count, void** out);
+void pool_free_bulk_to(pool_allocator_t* pool, void** ptrs, size_t count);
+void pool_free_sized_to(pool_allocator_t* pool, void* ptr, size_t n);
+void* pool_realloc_from(pool_allocator_t* pool, void* ptr, size_t n);
+size_t pool_usable_size_from(pool_allocator_t* pool, const void* ptr);
+
+
+/* pool_malloc_from() and pool_free_sized_to() for a size class already
+ * known to the caller, such as one computed at compile time by
+ * pool_alloc.hpp. size_class is the class of n (see SIZE_CLASS_COUNT).
+*/
+void* pool_malloc_class_from(pool_allocator_t* pool, size_t size_class, size_t n);
+void pool_free_class_to(pool_allocator_t* pool, void* ptr, size_t size_class);
+
+
+/* Return the calling thread's cached free blocks to the shared pools,
+ * and unbind its caches from their instances.
+ *
+ * Called automatically on thread exit. Has no effect unless
+ * POOL_THREAD_SAFE is 1.
+*/
+void pool_thread_cache_flush(void);
+
+
+/* Return the empty growth slabs of an instance to its slab_release().
+ *
+ * For instances created by pool_map(), also releases the pages of every
+ * pool with no block in use (MADV_DONTNEED). Blocks held in thread
+ * caches count as in use, and POOL_LOCK_FREE builds only trim slabs.
+ *
+ * Returns the number of slabs and pools released.
+*/
+size_t pool_trim(pool_allocator_t* pool);
+
+
+/* Growth slab sources for pool_config_t
+ *
+ * _parent: slabs are blocks of another instance, passed as ctx. Its
+ * blocks must hold slab_size bytes, and it must not be the growing
+ * instance itself.
+ *
+ * _mmap: slabs are anonymous private mappings, ctx is unused.
+*/
+void* pool_slab_acquire_parent(size_t size, void* ctx);
+void pool_slab_release_parent(void* slab, size_t size, void* ctx);
+void* pool_slab_acquire_mmap(size_t size, void* ctx);
+void pool_slab_release_mmap(void* slab, size_t size, void* ctx);
+
+
+/* Fill stats with the current usage of the global heap.
+ *
+ * Counters are updated with relaxed atomics in concurrent builds, so a
+ * snapshot taken while other threads allocate is not exact. In
+ * POOL_THREAD_SAFE builds each thread also holds back up to
+ * POOL_TCACHE_BATCH allocations and frees per pool before adding them
+ * to the shared counters, with the peak they reached in between. The
+ * calling thread's are added first.
+ *
+ * blocks - in_use is the number of blocks left before a pool (and its
+ * growth slabs) is exhausted.
+*/
+void pool_get_stats(pool_stats_t* stats);
+void pool_get_stats_from(pool_allocator_t* pool, pool_stats_t* stats);
+
+
+/* Call visit(block, block_size, ctx) for every block in use of an
+ * instance tracking blocks with bitmaps (see pool_config_t), in
+ * address order. Blocks held in thread caches count as in use.
+ *
+ * visit runs with the instance locked and must not call back into it.
+ * Returns the number of blocks visited, 0 for instances without bitmaps.
+*/
+typedef void (*pool_visit_t)(void* block, size_t block_size, void* ctx);
+size_t pool_visit_live(pool_visit_t visit, void* ctx);
+size_t pool_visit_live_from(pool_allocator_t* pool, pool_visit_t visit, void* ctx);
+
+
+/* Write stats to out as a single line JSON object, with one entry in
+ * "pools" per pool and the fields of pool_usage_t as keys.
+ *
+ * Returns false if writing failed.
+*/
+bool pool_dump_stats(const pool_stats_t* stats, FILE* out);
+
+
+/* Workload Profiles
+ *
+ * Recording of the requests a workload makes, to choose block sizes
+ * and pool capacities from (see pool_tune()) instead of guessing them.
+ * Requests are counted per size class (see SIZE_CLASS_COUNT) along with
+ * the bytes asked for and the most blocks of the class live at once.
+ *
+ * Live blocks are tracked by address in a table of POOL_PROFILE_SLOTS
+ * entries, a power of 2. Requests made while it is three quarters full
+ * are counted as untracked and never live, so peaks are underestimated.
+*/
+#ifndef POOL_PROFILE_SLOTS
+#define POOL_PROFILE_SLOTS	65536
+#endif
+
+POOL_STATIC_ASSERT(!(POOL_PROFILE_SLOTS & (POOL_PROFILE_SLOTS - 1)), "POOL_PROFILE_SLOTS must be a power of 2");
+POOL_STATIC_ASSERT(SIZE_CLASS_COUNT <= 256, "slot_classes holds size classes in a byte");
+
+typedef struct {
+	size_t requests[SIZE_CLASS_COUNT];
+	size_t bytes[SIZE_CLASS_COUNT];		// Sum of the requested sizes
+	size_t live[SIZE_CLASS_COUNT];
+	size_t peak_live[SIZE_CLASS_COUNT];	// Most live at once, per class
+	size_t untracked;
+	size_t tracked;						// Live blocks in the table
+	bool lock;
+
+	uintptr_t slot_ptrs[POOL_PROFILE_SLOTS];	// 0 for empty slots
+	uint8_t slot_classes[POOL_PROFILE_SLOTS];
+} pool_profile_t;
+
+
+/* Clear a profile before recording
+*/
+void pool_profile_reset(pool_profile_t* profile);
+
+
+/* Record a request of n bytes answered with ptr, or a free of ptr.
+ *
+ * Failed requests (ptr is NULL) are counted but never live, and frees
+ * of blocks the profile did not see allocated are ignored. Safe to call
+ * from several threads, but not from a signal handler.
+*/
+void pool_profile_malloc(pool_profile_t* profile, const void* ptr, size_t n);
+void pool_profile_free(pool_profile_t* profile, const void* ptr);
+
+
+/* Event hook recording into the profile passed as ctx, see
+ * pool_set_event_hook(). Requires POOL_TRACE_LEVEL 2, and only sees the
+ * requests the pools can fit.
+*/
+void pool_profile_hook(const pool_event_t* event, void* ctx);
+
+
+/* Write a profile to out as text, one line per size class requested:
+ *
+ *     pool_profile 1
+ *     untracked <count>
+ *     <class size> <requests> <bytes> <peak live>
+ *
+ * pool_profile_load() replaces profile with one read back from in.
+ * The live counts of a loaded profile are zero.
+ *
+ * Neither takes the profile's lock, and both return false on failure.
+*/
+bool pool_profile_save(const pool_profile_t* profile, FILE* out);
+bool pool_profile_load(pool_profile_t* profile, FILE* in);
+
+
+/* Pool Tuning
+ *
+ * Configuration recommended by pool_tune(), to pass as pool_config_t
+ * block_sizes, block_size_count and pool_block_counts.
+ *
+ * Classes whose blocks would take more than 1 / POOL_TUNE_MAX_BLOCK_SHARE
+ * of the heap are left to the system allocator.
+*/
+#ifndef POOL_TUNE_MAX_BLOCK_SHARE
+#define POOL_TUNE_MAX_BLOCK_SHARE	4
+#endif
+
+typedef struct {
+	size_t block_sizes[MAX_POOLS];
+	size_t block_counts[MAX_POOLS];
+	size_t count;
+	size_t heap_used;		// Bytes from the first pool to the end of the last
+	size_t shortfall;		// Peak live blocks beyond the pools' capacity
+	size_t waste;			// Bytes of the peak live blocks left unused by requests
+	size_t unfit;			// Requests left out for their block size
+} pool_tuning_t;
+
+
+/* Choose the block sizes and pool capacities of a heap_size bytes heap
+ * for a recorded workload.
+ *
+ * Requested classes are grouped into a power of 2 pools, each with the
+ * block size of its largest class. Grouping minimizes the waste of the
+ * peak live blocks, each holding its class's average request. As
+ * requests are fixed, that also minimizes the heap needed to hold every
+ * peak, up to the padding that ends each pool on a page. Peaks
+ * of different classes are taken as simultaneous, which overestimates
+ * the need of workloads whose phases use different sizes.
+ *
+ * The pools' capacities are then scaled to the heap: spare room is
+ * shared in proportion to each pool's peak bytes, and a heap too small
+ * for the peaks gives a shortfall. The number of pools is chosen last,
+ * by the least waste plus bytes of shortfall blocks once fitted.
+ *
+ * When align is non-zero, block sizes of align bytes or more are kept
+ * to multiples of it, as pool_preload.c needs for an align of 16.
+ *
+ * Returns false if the profile holds no request that fits the heap, or
+ * no valid configuration was found.
+*/
+bool pool_tune(const pool_profile_t* profile, size_t heap_size, size_t align, pool_tuning_t* tuning);
+
+
+/* NUMA Arenas
+ *
+ * pool_numa_init() gives every NUMA node its own arena, an instance
+ * created by pool_map() with a node_heap_size bytes heap bound to that
+ * node. From then on the global API works on the arenas instead of
+ * g_pool_heap: pool_malloc(), pool_aligned_malloc() and
+ * pool_malloc_bulk() serve the calling thread from the arena of the node
+ * it runs on, while pool_free() and the other calls taking a pointer
+ * return blocks to the arena they came from, whichever node frees them.
+ * Blocks allocated from g_pool_heap before still go back to it.
+ *
+ * The node of a thread is looked up with getcpu() every
+ * POOL_NUMA_REFRESH allocations, unless pool_numa_bind_thread() fixed it.
+ *
+ * When simulated_nodes is non-zero, that many arenas are created on
+ * whichever node first touches their pages, and CPU c is taken to belong
+ * to node c % simulated_nodes. Otherwise one arena is created per node
+ * listed in /sys/devices/system/node/online, up to POOL_NUMA_MAX_NODES,
+ * in the order listed. Arenas are then numbered 0 to count - 1 whatever
+ * the IDs of their nodes, and threads on a node without an arena (or
+ * with an ID of 256 or more, whose arena is left unbound) use arena 0.
+ *
+ * config is used for every arena with lazy forced on, so that pages are
+ * only touched once their node binding is in place. Growth slabs are not
+ * supported, since the home arena of a block is found by its address.
+ *
+ * Returns false if the inputs are invalid or an arena cannot be mapped,
+ * in which case the global API keeps using g_pool_heap. Like pool_init(),
+ * must not run concurrently with any other pool call, and replaces the
+ * arenas of an earlier call.
+*/
+bool pool_numa_init(const pool_config_t* config, size_t node_heap_size, size_t simulated_nodes);
+
+
+/* Destroy the arenas of pool_numa_init(), pool_malloc() and friends
+ * then use g_pool_heap again. Blocks still allocated from the arenas
+ * become invalid. Has no effect without arenas.
+ *
+ * As for pool_destroy(), every other thread that used the arenas must
+ * have exited or called pool_thread_cache_flush() first.
+*/
+void pool_numa_deinit(void);
+
+
+/* Number of arenas, 0 without pool_numa_init()
+*/
+size_t pool_numa_node_count(void);
+
+
+/* Arena number node, NULL if there is none, e.g. to pass to
+ * pool_get_stats_from() or pool_trim()
+*/
+pool_allocator_t* pool_numa_arena(size_t node);
+
+
+/* Number of the arena serving the calling thread's allocations
+*/
+size_t pool_numa_node(void);
+
+
+/* Serve the calling thread from arena number node (modulo the number of
+ * arenas) regardless of the CPU it runs on, as for threads pinned by the
+ * caller or to simulate nodes. A negative node restores the lookup.
+*/
+void pool_numa_bind_thread(int node);
+
+
+/* Store the node IDs of a node list in the format of
+ * /sys/devices/system/node/online, such as "0-1,4", in nodes.
+ *
+ * Returns the number of IDs stored, at most max_nodes. Parsing stops at
+ * the first malformed entry.
+*/
+size_t pool_numa_parse_nodes(const char* list, unsigned* nodes, size_t max_nodes);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif // POOL_ALLOC_H
\ No newline at end of file
@@ -0,0 +1,290 @@
+#ifndef POOL_ALLOC_HPP
+#define POOL_ALLOC_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "pool_alloc.h"
+
+/* C++ Interface
+ *
+ * Header-only layer over the C allocator, linked against pool_alloc.c
+ * built with POOL_LIBRARY.
+ *
+ * TunablePool<Sizes...> is an allocator instance whose size classes are
+ * template arguments, so the pool serving a fixed size is resolved at
+ * compile time. PoolAllocator<T> adapts any instance (the global heap by
+ * default) to the standard Allocator requirements.
+*/
+namespace pool_alloc {
+
+/* Size class of n bytes as used by the C allocator, see SIZE_CLASS_COUNT
+*/
+constexpr std::size_t size_class(std::size_t n)
+{
+	if(n <= 4) {
+		return n ? n - 1 : 0;
+	}
+	std::size_t e = std::numeric_limits<std::size_t>::digits - 1;
+	while(!((n - 1) >> e)) {
+		e--;
+	}
+	return 4 * (e - 1) + (((n - 1) >> (e - 2)) & 3);
+}
+
+/* Whether n is the largest size of its class, as block sizes must be
+*/
+constexpr bool is_class_size(std::size_t n)
+{
+	if(n <= 4) {
+		return n != 0;
+	}
+	std::size_t e = std::numeric_limits<std::size_t>::digits - 1;
+	while(!(n >> e)) {
+		e--;
+	}
+	return !(n & ((std::size_t(1) << (e - 2)) - 1));
+}
+
+/* Alignment of every block able to hold size class k, in any instance.
+ *
+ * Blocks are aligned to the largest power of 2 dividing their size, up
+ * to a cache line. Class sizes beyond 4 are m << (k / 4 - 1) with m from
+ * 5 to 8, so the block serving class k, or any larger one it spills to,
+ * is aligned to at least 1 << (k / 4 - 1).
+*/
+constexpr std::size_t class_alignment(std::size_t k)
+{
+	if(k < 4) {
+		return 1;
+	}
+	std::size_t shift = k / 4 - 1;
+	return (shift < 6) ? std::size_t(1) << shift : POOL_CACHE_LINE;
+}
+
+/* Whether blocks of n bytes are aligned for T without asking for it
+*/
+template<class T>
+constexpr bool class_aligned(std::size_t n)
+{
+	return class_alignment(size_class(n)) >= alignof(T);
+}
+
+
+template<std::size_t... Sizes>
+class TunablePool {
+public:
+	static constexpr std::size_t count = sizeof...(Sizes);
+	static constexpr std::size_t block_sizes[count] = {Sizes...};
+
+	/* Index of the smallest size class holding n bytes, count if none
+	 */
+	static constexpr std::size_t pool_of(std::size_t n)
+	{
+		for(std::size_t i = 0; i < count; i++) {
+			if(block_sizes[i] >= n) {
+				return i;
+			}
+		}
+		return count;
+	}
+
+	/* Alignment of every block able to hold n bytes, including those of
+	 * the larger pools it may spill to
+	 */
+	static constexpr std::size_t block_alignment(std::size_t n)
+	{
+		std::size_t align = POOL_CACHE_LINE;
+		for(std::size_t i = 0; i < count; i++) {
+			std::size_t block_align = block_sizes[i] & (~block_sizes[i] + 1);
+			if((block_sizes[i] >= n) && (block_align < align)) {
+				align = block_align;
+			}
+		}
+		return align;
+	}
+
+	/* Same input assumptions as pool_init(), checked at compile time
+	 */
+	static constexpr bool valid_sizes()
+	{
+		for(std::size_t i = 0; i < count; i++) {
+			if((block_sizes[i] < sizeof(pool_link_t)) || !is_class_size(block_sizes[i]) ||
+			   (i && (block_sizes[i] <= block_sizes[i - 1]))) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	static_assert((count > 0) && (count <= MAX_POOLS) && !(count & (count - 1)),
+	              "TunablePool takes a power of 2 sizes, up to MAX_POOLS");
+	static_assert(valid_sizes(), "sizes must be ascending class sizes of at least sizeof(pool_link_t)");
+
+	/* Create the instance over buffer, see pool_create_ex().
+	 * Check the result with operator bool.
+	 */
+	TunablePool(void* buffer, std::size_t size, pool_spill_t spill = POOL_SPILL_ANY)
+	{
+		pool_config_t config = {};
+		config.block_sizes = block_sizes;
+		config.block_size_count = count;
+		config.spill = spill;
+		pool_ = pool_create_ex(buffer, size, &config);
+	}
+
+	~TunablePool() { pool_destroy(pool_); }
+
+	TunablePool(const TunablePool&) = delete;
+	TunablePool& operator=(const TunablePool&) = delete;
+
+	explicit operator bool() const noexcept { return pool_ != nullptr; }
+	pool_allocator_t* get() const noexcept { return pool_; }
+
+	/* Allocate or release N bytes, with the size class resolved at
+	 * compile time.
+	 */
+	template<std::size_t N>
+	void* allocate() noexcept
+	{
+		static_assert(pool_of(N) < count, "no size class holds N bytes");
+		return pool_malloc_class_from(pool_, size_class(N), N);
+	}
+
+	template<std::size_t N>
+	void deallocate(void* ptr) noexcept
+	{
+		pool_free_class_to(pool_, ptr, size_class(N));
+	}
+
+	// Runtime sized counterparts
+	void* allocate(std::size_t n) noexcept { return pool_malloc_from(pool_, n); }
+	void deallocate(void* ptr) noexcept { pool_free_to(pool_, ptr); }
+
+	/* Construct a T in a block of its size class, aligned for T.
+	 *
+	 * The size class is resolved at compile time unless the blocks that
+	 * could serve it are not all aligned for T.
+	 *
+	 * Returns nullptr if the pools are exhausted.
+	 */
+	template<class T, class... Args>
+	T* create(Args&&... args)
+	{
+		static_assert(pool_of(sizeof(T)) < count, "no size class holds T");
+		void* ptr;
+		if constexpr(block_alignment(sizeof(T)) >= alignof(T)) {
+			ptr = allocate<sizeof(T)>();
+		}
+		else {
+			ptr = pool_aligned_malloc_from(pool_, sizeof(T), alignof(T));
+		}
+		if(!ptr) {
+			return nullptr;
+		}
+		try {
+			return new(ptr) T(std::forward<Args>(args)...);
+		}
+		catch(...) {
+			deallocate<sizeof(T)>(ptr);
+			throw;
+		}
+	}
+
+	template<class T>
+	void destroy(T* obj) noexcept
+	{
+		if(obj) {
+			obj->~T();
+			deallocate<sizeof(T)>(obj);
+		}
+	}
+
+private:
+	pool_allocator_t* pool_;
+};
+
+
+/* Standard Allocator over an allocator instance
+ *
+ * Blocks are only aligned to the largest power of 2 dividing their
+ * size, so allocations are served by size class when every block able
+ * to hold them is aligned for T (see class_alignment()), and through
+ * pool_aligned_malloc_from() otherwise. For single objects that choice
+ * and the size class of T are resolved at compile time. Throws
+ * std::bad_alloc when the pools are exhausted.
+*/
+template<class T>
+class PoolAllocator {
+public:
+	using value_type = T;
+
+	PoolAllocator() noexcept : pool_(&pool_controller) {}
+	explicit PoolAllocator(pool_allocator_t* pool) noexcept : pool_(pool) {}
+
+	template<std::size_t... Sizes>
+	PoolAllocator(TunablePool<Sizes...>& pool) noexcept : pool_(pool.get()) {}
+
+	template<class U>
+	PoolAllocator(const PoolAllocator<U>& other) noexcept : pool_(other.pool()) {}
+
+	T* allocate(std::size_t n)
+	{
+		if(n > std::numeric_limits<std::size_t>::max() / sizeof(T)) {
+			throw std::bad_array_new_length();
+		}
+
+		void* ptr;
+		if(n == 1) {
+			if constexpr(class_aligned<T>(sizeof(T))) {
+				ptr = pool_malloc_class_from(pool_, size_class(sizeof(T)), sizeof(T));
+			}
+			else {
+				ptr = pool_aligned_malloc_from(pool_, sizeof(T), alignof(T));
+			}
+		}
+		else {
+			std::size_t bytes = n * sizeof(T);
+			std::size_t k = size_class_of(bytes);
+			if(class_alignment(k) >= alignof(T)) {
+				ptr = pool_malloc_class_from(pool_, k, bytes);
+			}
+			else {
+				ptr = pool_aligned_malloc_from(pool_, bytes, alignof(T));
+			}
+		}
+
+		if(!ptr) {
+			throw std::bad_alloc();
+		}
+		return static_cast<T*>(ptr);
+	}
+
+	void deallocate(T* ptr, std::size_t n) noexcept
+	{
+		if(n == 1) {
+			pool_free_class_to(pool_, ptr, size_class(sizeof(T)));
+		}
+		else {
+			pool_free_sized_to(pool_, ptr, n * sizeof(T));
+		}
+	}
+
+	pool_allocator_t* pool() const noexcept { return pool_; }
+
+	template<class U>
+	bool operator==(const PoolAllocator<U>& other) const noexcept { return pool_ == other.pool(); }
+	template<class U>
+	bool operator!=(const PoolAllocator<U>& other) const noexcept { return pool_ != other.pool(); }
+
+private:
+	pool_allocator_t* pool_;
+};
+
+} // namespace pool_alloc
+
+#endif // POOL_ALLOC_HPP
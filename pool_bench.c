@@ -0,0 +1,404 @@
+#include "pool_alloc.h"
+#include <dlfcn.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/* Benchmarks
+ *
+ * Built by the bench target into build/pool_bench.o:
+ *
+ *     build/pool_bench.o [ops] [workload]
+ *
+ * Runs every workload against the pool allocator, glibc malloc and,
+ * when their shared libraries can be loaded, jemalloc and tcmalloc.
+ * An op is one malloc() or one free() call, ops defaults to
+ * BENCH_DEFAULT_OPS per run.
+ *
+ * Each run happens in a child process of its own, so the reported
+ * maximum RSS belongs to that allocator and workload alone, plus the
+ * latency samples every allocator pays for alike. Latency is sampled
+ * once per BENCH_BATCH ops to keep clock reads out of the measurement,
+ * percentiles are over those batch averages. Sizes and free orders come
+ * from a fixed seed and are identical across allocators.
+*/
+#define BENCH_DEFAULT_OPS	2000000
+#define BENCH_BATCH			64
+#define BENCH_WINDOW		4096	// Live blocks of the window workloads
+#define BENCH_RING			1024	// Producer/consumer queue entries
+#define BENCH_SEED			0x9E3779B97F4A7C15ull
+
+static const size_t bench_block_sizes[] = {16, 32, 64, 128, 256, 512, 1024, 2048};
+
+typedef struct {
+	const char* name;
+	void* (*malloc)(size_t n);
+	void (*free)(void* ptr);
+} bench_allocator_t;
+
+typedef struct {
+	uint64_t* samples;				// ns per op, one per batch
+	size_t count;
+	size_t capacity;
+	size_t pending;					// Ops since the last sample
+	uint64_t last;
+	bool failed;					// An allocation returned NULL
+} bench_timer_t;
+
+typedef struct {
+	const char* name;
+	void (*run)(const bench_allocator_t* alloc, bench_timer_t* timer, size_t ops);
+} bench_workload_t;
+
+
+/* BEGIN Helpers */
+
+static inline uint64_t bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline uint64_t bench_random(uint64_t* state)
+{
+	// xorshift64*
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545F4914F6CDD1Dull;
+}
+
+static void bench_timer_start(bench_timer_t* timer, size_t ops)
+{
+	timer->capacity = ops / BENCH_BATCH + 1;
+	timer->samples = calloc(timer->capacity, sizeof(uint64_t));
+	timer->count = 0;
+	timer->pending = 0;
+	timer->failed = false;
+	timer->last = bench_now();
+}
+
+/* Count one op, sampling the latency of every BENCH_BATCH ops
+*/
+static inline void bench_op(bench_timer_t* timer)
+{
+	if(++timer->pending == BENCH_BATCH) {
+		uint64_t now = bench_now();
+		if(timer->count < timer->capacity) {
+			timer->samples[timer->count++] = (now - timer->last) / BENCH_BATCH;
+		}
+		timer->pending = 0;
+		timer->last = now;
+	}
+}
+
+static inline void* bench_malloc(const bench_allocator_t* alloc, bench_timer_t* timer, size_t n)
+{
+	uint8_t* ptr = alloc->malloc(n);
+	if(!ptr) {
+		timer->failed = true;
+		return NULL;
+	}
+	ptr[0] = (uint8_t)n;  // Touch the block like a real caller would
+	bench_op(timer);
+	return ptr;
+}
+
+static inline void bench_free(const bench_allocator_t* alloc, bench_timer_t* timer, void* ptr)
+{
+	alloc->free(ptr);
+	bench_op(timer);
+}
+
+/* Request size of the mixed workload: 60% up to 64 bytes, 30% up to
+ * 512 and 10% up to 2048
+*/
+static size_t bench_mixed_size(uint64_t* state)
+{
+	uint64_t r = bench_random(state);
+	size_t bucket = r % 10;
+	size_t limit = (bucket < 6) ? 64 : (bucket < 9) ? 512 : 2048;
+	return 1 + (r >> 32) % limit;
+}
+
+static int bench_compare(const void* a, const void* b)
+{
+	uint64_t x = *(const uint64_t*)a;
+	uint64_t y = *(const uint64_t*)b;
+	return (x > y) - (x < y);
+}
+
+/* END Helpers */
+
+
+/* BEGIN Workloads */
+
+// Allocate and immediately free one 64 byte block
+static void bench_fixed(const bench_allocator_t* alloc, bench_timer_t* timer, size_t ops)
+{
+	for(size_t i = 0; (i < ops / 2) && !timer->failed; i++) {
+		void* ptr = bench_malloc(alloc, timer, 64);
+		bench_free(alloc, timer, ptr);
+	}
+}
+
+/* Fill a window of 64 byte blocks, then free it in LIFO, FIFO or a
+ * random (fixed per window position) order
+*/
+static void bench_window(const bench_allocator_t* alloc, bench_timer_t* timer, size_t ops, int order)
+{
+	static void* ptrs[BENCH_WINDOW];
+	static size_t perm[BENCH_WINDOW];
+	uint64_t state = BENCH_SEED;
+
+	// Fisher-Yates shuffle of the free order
+	for(size_t i = 0; i < BENCH_WINDOW; i++) {
+		perm[i] = (order == 0) ? BENCH_WINDOW - 1 - i : i;
+	}
+	for(size_t i = BENCH_WINDOW - 1; (order == 2) && (i > 0); i--) {
+		size_t j = bench_random(&state) % (i + 1);
+		size_t tmp = perm[i];
+		perm[i] = perm[j];
+		perm[j] = tmp;
+	}
+
+	for(size_t done = 0; (done < ops) && !timer->failed; done += 2 * BENCH_WINDOW) {
+		for(size_t i = 0; i < BENCH_WINDOW; i++) {
+			ptrs[i] = bench_malloc(alloc, timer, 64);
+		}
+		for(size_t i = 0; i < BENCH_WINDOW; i++) {
+			bench_free(alloc, timer, ptrs[perm[i]]);
+		}
+	}
+}
+
+static void bench_lifo(const bench_allocator_t* alloc, bench_timer_t* timer, size_t ops)
+{
+	bench_window(alloc, timer, ops, 0);
+}
+
+static void bench_fifo(const bench_allocator_t* alloc, bench_timer_t* timer, size_t ops)
+{
+	bench_window(alloc, timer, ops, 1);
+}
+
+static void bench_shuffled(const bench_allocator_t* alloc, bench_timer_t* timer, size_t ops)
+{
+	bench_window(alloc, timer, ops, 2);
+}
+
+/* Keep a window of mixed size blocks live, replacing a random one at
+ * each step
+*/
+static void bench_mixed(const bench_allocator_t* alloc, bench_timer_t* timer, size_t ops)
+{
+	static void* ptrs[BENCH_WINDOW];
+	uint64_t state = BENCH_SEED;
+
+	for(size_t i = 0; i < BENCH_WINDOW; i++) {
+		ptrs[i] = bench_malloc(alloc, timer, bench_mixed_size(&state));
+	}
+	for(size_t done = BENCH_WINDOW; (done < ops) && !timer->failed; done += 2) {
+		size_t slot = bench_random(&state) % BENCH_WINDOW;
+		bench_free(alloc, timer, ptrs[slot]);
+		ptrs[slot] = bench_malloc(alloc, timer, bench_mixed_size(&state));
+	}
+	for(size_t i = 0; i < BENCH_WINDOW; i++) {
+		alloc->free(ptrs[i]);
+	}
+}
+
+/* Producer thread allocates, consumer thread frees, through a single
+ * producer single consumer ring
+*/
+typedef struct {
+	const bench_allocator_t* alloc;
+	bench_timer_t timer;
+	size_t count;
+	void* ring[BENCH_RING];
+	size_t head;					// Next entry the producer writes
+	size_t tail;					// Next entry the consumer reads
+} bench_queue_t;
+
+static void* bench_consumer(void* arg)
+{
+	bench_queue_t* queue = arg;
+	bench_timer_start(&queue->timer, queue->count);
+
+	for(size_t i = 0; i < queue->count; i++) {
+		while(__atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) == i) {
+			sched_yield();
+		}
+		void* ptr = queue->ring[i % BENCH_RING];
+		__atomic_store_n(&queue->tail, i + 1, __ATOMIC_RELEASE);
+		bench_free(queue->alloc, &queue->timer, ptr);
+	}
+	return NULL;
+}
+
+static void bench_cross_thread(const bench_allocator_t* alloc, bench_timer_t* timer, size_t ops)
+{
+	static bench_queue_t queue;
+	queue.alloc = alloc;
+	queue.count = ops / 2;
+	queue.head = 0;
+	queue.tail = 0;
+
+	pthread_t consumer;
+	pthread_create(&consumer, NULL, bench_consumer, &queue);
+
+	// Failed allocations are passed on as NULL, so the consumer always
+	// sees count entries
+	for(size_t produced = 0; produced < queue.count; produced++) {
+		while(produced - __atomic_load_n(&queue.tail, __ATOMIC_ACQUIRE) == BENCH_RING) {
+			sched_yield();
+		}
+		queue.ring[produced % BENCH_RING] = bench_malloc(alloc, timer, 64);
+		__atomic_store_n(&queue.head, produced + 1, __ATOMIC_RELEASE);
+	}
+	pthread_join(consumer, NULL);
+
+	// Merge the consumer's samples into the caller's
+	size_t merged = timer->capacity - timer->count;
+	merged = (queue.timer.count < merged) ? queue.timer.count : merged;
+	memcpy(&timer->samples[timer->count], queue.timer.samples, merged * sizeof(uint64_t));
+	timer->count += merged;
+	free(queue.timer.samples);
+}
+
+static const bench_workload_t bench_workloads[] = {
+	{"fixed", bench_fixed},
+	{"lifo", bench_lifo},
+	{"fifo", bench_fifo},
+	{"random", bench_shuffled},
+	{"mixed", bench_mixed},
+	{"cross_thread", bench_cross_thread},
+};
+
+/* END Workloads */
+
+
+/* BEGIN Allocators */
+
+static void* bench_pool_malloc(size_t n)
+{
+	return pool_malloc(n);
+}
+
+static void bench_pool_free(void* ptr)
+{
+	pool_free(ptr);
+}
+
+static void* bench_system_malloc(size_t n)
+{
+	return malloc(n);
+}
+
+static void bench_system_free(void* ptr)
+{
+	free(ptr);
+}
+
+/* Resolve the allocator of a shared library into alloc.
+ *
+ * Returns false if the library is not installed.
+*/
+static bool bench_load_library(bench_allocator_t* alloc, const char* const* paths)
+{
+	for(; *paths; paths++) {
+		void* handle = dlopen(*paths, RTLD_NOW | RTLD_LOCAL);
+		if(handle) {
+			alloc->malloc = (void* (*)(size_t))dlsym(handle, "malloc");
+			alloc->free = (void (*)(void*))dlsym(handle, "free");
+			return alloc->malloc && alloc->free;
+		}
+	}
+	return false;
+}
+
+static const char* const bench_jemalloc_paths[] = {"libjemalloc.so.2", "libjemalloc.so", NULL};
+static const char* const bench_tcmalloc_paths[] = {
+	"libtcmalloc_minimal.so.4", "libtcmalloc.so.4", "libtcmalloc_minimal.so", NULL
+};
+
+/* END Allocators */
+
+
+/* Run workload against the allocator in a child process and print a
+ * result line.
+*/
+static void bench_run(const bench_workload_t* workload, const char* name, size_t ops)
+{
+	fflush(stdout);
+	pid_t pid = fork();
+	if(pid) {
+		waitpid(pid, NULL, 0);
+		return;
+	}
+
+	bench_allocator_t alloc = {name, bench_system_malloc, bench_system_free};
+	if(!strcmp(name, "pool")) {
+		pool_config_t config = {
+			.block_sizes = bench_block_sizes,
+			.block_size_count = sizeof(bench_block_sizes) / sizeof(bench_block_sizes[0]),
+			.lazy = true
+		};
+		pool_init_ex(&config);
+		alloc.malloc = bench_pool_malloc;
+		alloc.free = bench_pool_free;
+	}
+	else if((!strcmp(name, "jemalloc") && !bench_load_library(&alloc, bench_jemalloc_paths)) ||
+	        (!strcmp(name, "tcmalloc") && !bench_load_library(&alloc, bench_tcmalloc_paths))) {
+		_exit(0);  // Not installed
+	}
+
+	bench_timer_t timer;
+	bench_timer_start(&timer, ops);
+	uint64_t start = bench_now();
+	workload->run(&alloc, &timer, ops);
+	uint64_t elapsed = bench_now() - start;
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	if(timer.failed || !timer.count) {
+		printf("%-13s %-9s %s\n", workload->name, name, timer.failed ? "allocation failed" : "too few ops");
+	}
+	else {
+		qsort(timer.samples, timer.count, sizeof(uint64_t), bench_compare);
+		printf("%-13s %-9s %8.2f %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %10ld\n",
+		       workload->name, name, (double)elapsed / ops,
+		       timer.samples[timer.count / 2],
+		       timer.samples[timer.count * 99 / 100],
+		       timer.samples[timer.count * 999 / 1000],
+		       usage.ru_maxrss);
+	}
+	fflush(stdout);
+	_exit(0);
+}
+
+int main(int argc, char** argv)
+{
+	static const char* const allocators[] = {"pool", "glibc", "jemalloc", "tcmalloc"};
+	size_t ops = (argc > 1) ? strtoull(argv[1], NULL, 10) : BENCH_DEFAULT_OPS;
+	const char* only = (argc > 2) ? argv[2] : NULL;
+
+	printf("%-13s %-9s %8s %8s %8s %8s %10s\n",
+	       "workload", "allocator", "ns/op", "p50", "p99", "p99.9", "maxrss_kb");
+	for(size_t i = 0; i < sizeof(bench_workloads) / sizeof(bench_workloads[0]); i++) {
+		if(only && strcmp(only, bench_workloads[i].name)) {
+			continue;
+		}
+		for(size_t j = 0; j < sizeof(allocators) / sizeof(allocators[0]); j++) {
+			bench_run(&bench_workloads[i], allocators[j], ops);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,318 @@
+#define _GNU_SOURCE
+#include "pool_alloc.h"
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Malloc Interposition
+ *
+ * Built by the preload target into build/libpool_preload.so, to run
+ * unmodified binaries on the global heap:
+ *
+ *     LD_PRELOAD=build/libpool_preload.so ./app
+ *
+ * Requests up to the largest block size are served by the pools and
+ * everything else, including requests the pools cannot serve, by the
+ * system allocator. free() tells the two apart by the heap address range.
+ *
+ * Block sizes default to preload_block_sizes and can be set with a comma
+ * separated list in POOL_PRELOAD_SIZES, under pool_init()'s input
+ * assumptions. Sizes of 16 bytes or more must also be multiples of 16,
+ * as blocks are only aligned to the largest power of 2 dividing their
+ * size. Writing every entry as size:count sets the pools' block counts
+ * too, as printed by the tune target's build/pool_tune.o. The heap is
+ * initialized lazily on the first request.
+ *
+ * When POOL_PRELOAD_PROFILE names a file, every request is recorded in
+ * a pool_profile_t written to that file at exit, see pool_tune().
+ *
+ * fork() is safe while other threads allocate, and the child may keep
+ * using the heap.
+ *
+ * The library is built with hidden visibility so that only the functions
+ * below are interposed, and with initial-exec TLS so that thread caches
+ * never allocate.
+*/
+#define POOL_PRELOAD_EXPORT	__attribute__((visibility("default")))
+
+// glibc's own allocator entry points
+extern void* __libc_malloc(size_t n);
+extern void __libc_free(void* ptr);
+extern void* __libc_calloc(size_t count, size_t n);
+extern void* __libc_realloc(void* ptr, size_t n);
+extern void* __libc_memalign(size_t align, size_t n);
+
+static const size_t preload_block_sizes[] = {16, 32, 64, 128, 256, 512, 1024, 2048};
+
+static pthread_once_t g_preload_once = PTHREAD_ONCE_INIT;
+static size_t g_preload_max_block;	// 0 while the heap is unusable
+
+static pool_profile_t g_preload_profile_storage;
+static pool_profile_t* g_preload_profile;	// NULL unless recording
+static const char* g_preload_profile_path;
+
+/* Parse POOL_PRELOAD_SIZES into block_sizes, and block_counts if every
+ * entry has one, returning the count or 0 when the variable is unset or
+ * malformed.
+*/
+static size_t preload_parse_sizes(size_t* block_sizes, size_t* block_counts, bool* counted)
+{
+	const char* env = getenv("POOL_PRELOAD_SIZES");
+	size_t count = 0;
+	size_t with_counts = 0;
+
+	while(env && *env && (count < MAX_POOLS)) {
+		char* end;
+		block_sizes[count] = strtoul(env, &end, 10);
+		if((end != env) && (*end == ':')) {
+			env = end + 1;
+			block_counts[with_counts++] = strtoul(env, &end, 10);
+		}
+		if((end == env) || ((*end != ',') && (*end != '\0'))) {
+			return 0;
+		}
+		count++;
+		env = (*end == ',') ? end + 1 : end;
+	}
+	*counted = with_counts && (with_counts == count);
+	return (env && !*env && (!with_counts || *counted)) ? count : 0;
+}
+
+static void preload_profile_save(void)
+{
+	FILE* out = fopen(g_preload_profile_path, "w");
+	if(out) {
+		pool_profile_save(g_preload_profile, out);
+		fclose(out);
+	}
+}
+
+/* Keep fork() from copying the heap or the profile mid-update: the
+ * forking thread holds both locks across it, and the child, its only
+ * thread, starts them over. Blocks cached by the parent's other threads
+ * stay out of reach in the child.
+*/
+static void preload_fork_prepare(void)
+{
+	if(g_preload_profile) {
+		while(__atomic_test_and_set(&g_preload_profile->lock, __ATOMIC_ACQUIRE)) {
+		}
+	}
+	pthread_mutex_lock(&pool_controller.lock);
+}
+
+static void preload_fork_parent(void)
+{
+	pthread_mutex_unlock(&pool_controller.lock);
+	if(g_preload_profile) {
+		__atomic_clear(&g_preload_profile->lock, __ATOMIC_RELEASE);
+	}
+}
+
+static void preload_fork_child(void)
+{
+	pthread_mutex_init(&pool_controller.lock, NULL);
+	if(g_preload_profile) {
+		g_preload_profile->lock = false;
+	}
+}
+
+static void preload_init(void)
+{
+	size_t block_sizes[MAX_POOLS];
+	size_t block_counts[MAX_POOLS];
+	bool counted = false;
+	pool_config_t config = {0};
+
+	config.block_sizes = block_sizes;
+	config.block_size_count = preload_parse_sizes(block_sizes, block_counts, &counted);
+	config.pool_block_counts = counted ? block_counts : NULL;
+	config.lazy = true;  // Leave untouched pages unmapped until used
+
+	// malloc() must align blocks of 16 bytes or more like glibc does
+	bool aligned = true;
+	for(size_t i = 0; i < config.block_size_count; i++) {
+		aligned &= (block_sizes[i] < 16) || !(block_sizes[i] % 16);
+	}
+
+	if(!aligned || !verify_pool_config(HEAP_SIZE, &config)) {
+		config.block_sizes = preload_block_sizes;
+		config.block_size_count = sizeof(preload_block_sizes) / sizeof(preload_block_sizes[0]);
+		config.pool_block_counts = NULL;
+	}
+
+	if(pool_init_ex(&config)) {
+		g_preload_max_block = config.block_sizes[config.block_size_count - 1];
+	}
+
+	g_preload_profile_path = getenv("POOL_PRELOAD_PROFILE");
+	if(g_preload_profile_path && *g_preload_profile_path) {
+		g_preload_profile = &g_preload_profile_storage;
+		atexit(preload_profile_save);
+	}
+	pthread_atfork(preload_fork_prepare, preload_fork_parent, preload_fork_child);
+}
+
+/* Record a request answered with ptr, or a free of ptr, when profiling
+*/
+static inline void* preload_record(void* ptr, size_t n)
+{
+	if(g_preload_profile) {
+		pool_profile_malloc(g_preload_profile, ptr, n);
+	}
+	return ptr;
+}
+
+static inline void preload_record_free(void* ptr)
+{
+	if(g_preload_profile) {
+		pool_profile_free(g_preload_profile, ptr);
+	}
+}
+
+/* Record realloc() of ptr to n bytes. ptr stays live unless moved, the
+ * resized block, was obtained.
+*/
+static inline void* preload_record_realloc(void* ptr, void* moved, size_t n)
+{
+	if(moved) {
+		preload_record_free(ptr);
+	}
+	return preload_record(moved, n);
+}
+
+/* Whether the pools take n bytes, zero byte requests go to the system
+*/
+static inline bool preload_fits(size_t n)
+{
+	pthread_once(&g_preload_once, preload_init);
+	return (n - 1) < g_preload_max_block;
+}
+
+static inline bool preload_owns(const void* ptr)
+{
+	return ((uintptr_t)ptr - (uintptr_t)g_pool_heap) < HEAP_SIZE;
+}
+
+static void* preload_aligned_malloc(size_t align, size_t n)
+{
+	if(preload_fits(n) && (align <= g_preload_max_block)) {
+		void* ptr = pool_aligned_malloc(n, align);
+		if(ptr) {
+			return preload_record(ptr, n);
+		}
+	}
+	return preload_record(__libc_memalign(align, n), n);
+}
+
+POOL_PRELOAD_EXPORT void* malloc(size_t n)
+{
+	if(preload_fits(n)) {
+		void* ptr = pool_malloc(n);
+		if(ptr) {
+			return preload_record(ptr, n);
+		}
+	}
+	return preload_record(__libc_malloc(n), n);
+}
+
+POOL_PRELOAD_EXPORT void free(void* ptr)
+{
+	preload_record_free(ptr);
+	if(preload_owns(ptr)) {
+		pool_free(ptr);
+	}
+	else {
+		__libc_free(ptr);
+	}
+}
+
+POOL_PRELOAD_EXPORT void* calloc(size_t count, size_t n)
+{
+	size_t total;
+	if(__builtin_mul_overflow(count, n, &total)) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	if(preload_fits(total)) {
+		void* ptr = pool_malloc(total);
+		if(ptr) {
+			// Freed blocks hold free list links, so always clear
+			return preload_record(memset(ptr, 0, total), total);
+		}
+	}
+	return preload_record(__libc_calloc(count, n), total);
+}
+
+POOL_PRELOAD_EXPORT void* realloc(void* ptr, size_t n)
+{
+	if(!ptr) {
+		return malloc(n);
+	}
+	if(!n) {
+		preload_record_free(ptr);
+		if(preload_owns(ptr)) {
+			pool_free(ptr);
+			return NULL;
+		}
+		return __libc_realloc(ptr, n);
+	}
+	if(!preload_owns(ptr)) {
+		return preload_record_realloc(ptr, __libc_realloc(ptr, n), n);
+	}
+
+	// Requests past the largest block leave the pools
+	void* moved = (n <= g_preload_max_block) ? pool_realloc(ptr, n) : NULL;
+	if(!moved) {
+		moved = __libc_malloc(n);
+		if(moved) {
+			memcpy(moved, ptr, pool_usable_size(ptr));
+			pool_free(ptr);
+		}
+	}
+	return preload_record_realloc(ptr, moved, n);
+}
+
+POOL_PRELOAD_EXPORT int posix_memalign(void** out, size_t align, size_t n)
+{
+	if(!align || (align & (align - 1)) || (align % sizeof(void*))) {
+		return EINVAL;
+	}
+
+	void* ptr = preload_aligned_malloc(align, n);
+	if(!ptr) {
+		return ENOMEM;
+	}
+	*out = ptr;
+	return 0;
+}
+
+POOL_PRELOAD_EXPORT void* aligned_alloc(size_t align, size_t n)
+{
+	if(!align || (align & (align - 1))) {
+		errno = EINVAL;
+		return NULL;
+	}
+	return preload_aligned_malloc(align, n);
+}
+
+POOL_PRELOAD_EXPORT void* memalign(size_t align, size_t n)
+{
+	return aligned_alloc(align, n);
+}
+
+POOL_PRELOAD_EXPORT size_t malloc_usable_size(void* ptr)
+{
+	static size_t (*system_usable_size)(void*);
+
+	if(preload_owns(ptr)) {
+		return pool_usable_size(ptr);
+	}
+	if(!system_usable_size) {
+		system_usable_size = (size_t (*)(void*))dlsym(RTLD_NEXT, "malloc_usable_size");
+	}
+	return ptr ? system_usable_size(ptr) : 0;
+}
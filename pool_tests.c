@@ -66,13 +66,12 @@ bool verify_heap_init_pool_controller(const size_t* block_sizes, size_t block_si
 bool verify_heap_init_block_references(const size_t* block_sizes, size_t block_size_count) {
 	bool correct = true;
 	
-	uint32_t pool_begin, last_block, next_block; 
+	pool_link_t pool_begin, last_block, next_block; 
 	for(size_t i = 0; i < block_size_count; i++) {
 		pool_begin = pool_controller.pool_begin_indices[i];
 		last_block   = pool_controller.pool_end_indices[i];
 
-		// Re-construct 16-bit address based on two 8-bit elements
-		next_block = (g_pool_heap[pool_begin+1] << 8) | g_pool_heap[pool_begin];
+		next_block = pool_link_read(g_pool_heap, pool_begin);
 
 		// Verify behaviour for pools that can hold more than one block
 		if(block_sizes[i] < HEAP_SIZE / block_size_count) {
@@ -81,14 +80,14 @@ bool verify_heap_init_block_references(const size_t* block_sizes, size_t block_s
 				correct = false; 
 			}
 
-			// Check that final block refers back to first block in pool
-			next_block = (g_pool_heap[last_block+1] << 8) | g_pool_heap[last_block]; 
-			if(next_block != pool_begin) {
+			// Check that final block ends the free list
+			next_block = pool_link_read(g_pool_heap, last_block);
+			if(next_block != POOL_NULL_LINK) {
 				correct = false;
 			}
 		}
 		// Verify behaviour for pools that can only hold one block
-		else if (next_block != pool_begin){
+		else if (next_block != POOL_NULL_LINK){
 			correct = false;
 		}
 	}
@@ -103,30 +102,34 @@ bool verify_heap_init_block_references(const size_t* block_sizes, size_t block_s
 void TestRunner(void) {
 	printf("Starting Test Runner\n\n");
 
+	// Blocks smaller than a free list link are rejected
 	printf("Tests 1-7: Input verification\n");
 	assert(!test_inputs_small_none());
-	assert(test_inputs_small_single());
-	assert(test_inputs_small_multiple());
+	assert(test_inputs_small_single() == (sizeof(pool_link_t) <= 4));
+	assert(test_inputs_small_multiple() == (sizeof(pool_link_t) <= 2));
 
 	assert(test_inputs_large_single());
 	assert(test_inputs_large_multiple());
 
-	assert(test_inputs_mixed_multiple());
+	assert(test_inputs_mixed_multiple() == (sizeof(pool_link_t) <= 2));
 	assert(test_inputs_max_single());
 	assert(!test_inputs_exceed_single());
+	assert(!test_inputs_unordered_multiple());
 	printf("Tests 1-8: PASS\n\n");
 	
 	printf("Tests 9-14: Pool initialization\n");
-	assert(test_pool_init_small_single());
-	assert(test_pool_init_small_multiple());
+	assert(test_pool_init_small_single() == (sizeof(pool_link_t) <= 4));
+	assert(test_pool_init_small_multiple() == (sizeof(pool_link_t) <= 2));
 
 	assert(test_pool_init_large_single());
 	assert(test_pool_init_large_multiple());
 
-	assert(test_pool_init_mixed_multiple());
+	assert(test_pool_init_mixed_multiple() == (sizeof(pool_link_t) <= 2));
 	assert(test_pool_init_max_single());
 	printf("Tests 9-14: PASS\n\n");
 
+#if !POOL_THREAD_SAFE && !POOL_LOCK_FREE
+	// Thread caches and tagged heads bypass the free list state inspected here
 	printf("Tests 15-20: Pool malloc\n");
 	printf("\nBEGIN TEST 15\n");
 	assert(test_pool_malloc_single_single());
@@ -135,7 +138,9 @@ void TestRunner(void) {
 	assert(test_pool_malloc_single_multiple());
 
 	printf("\nBEGIN TEST 17\n");
-	assert(test_pool_malloc_multiple_single()); 
+	if(sizeof(pool_link_t) <= 4) { // 4-byte blocks
+		assert(test_pool_malloc_multiple_single()); 
+	}
 
 	printf("\nBEGIN TEST 18\n");
 	assert(test_pool_malloc_multiple_multiple());
@@ -156,6 +161,160 @@ void TestRunner(void) {
 	assert(test_pool_free_multiple());
 
 	printf("Tests 20-21: PASS\n\n");
+#endif
+
+	printf("Tests 23-25: Size class lookup\n");
+	if(sizeof(pool_link_t) <= 2) { // 2-byte blocks
+		assert(test_size_class_boundaries());
+	}
+	assert(test_size_class_oversized());
+	assert(test_size_class_spill());
+	printf("Tests 23-25: PASS\n\n");
+
+#if !POOL_THREAD_SAFE && !POOL_LOCK_FREE
+	printf("Tests 26-27: Pool free owner lookup\n");
+	if(sizeof(pool_link_t) <= 2) { // 2-byte blocks
+		assert(test_pool_free_owner_lookup());
+	}
+	if(sizeof(pool_link_t) <= 4) { // 4-byte blocks
+		assert(test_pool_free_owner_lookup_non_pow2());
+	}
+	printf("Tests 26-27: PASS\n\n");
+#endif
+
+	printf("Test 28: Event trace (level %d)\n", POOL_TRACE_LEVEL);
+	assert(test_trace_events());
+	printf("Test 28: PASS\n\n");
+
+#if POOL_THREAD_SAFE
+	printf("Tests 29-31: Thread caches\n");
+	assert(test_thread_cache_reuse());
+	assert(test_thread_cache_exit_flush());
+	assert(test_thread_cache_stress());
+	printf("Tests 29-31: PASS\n\n");
+#endif
+
+#if POOL_LOCK_FREE
+	printf("Tests 32-33: Lock-free free lists\n");
+	assert(test_lock_free_tagged_head());
+	assert(test_lock_free_cross_thread_free());
+	printf("Tests 32-33: PASS\n\n");
+#endif
+
+	printf("Tests 34-36: Allocator instances\n");
+	assert(test_instance_separate_heaps());
+	assert(test_instance_invalid_inputs());
+	assert(test_instance_exhaustion_isolated());
+	printf("Tests 34-36: PASS\n\n");
+
+#if POOL_LINK_BITS > 16
+	printf("Test 37: Wide free list links\n");
+	assert(test_link_wide_instance());
+	printf("Test 37: PASS\n\n");
+#endif
+
+	printf("Tests 38-41: Lazy initialization\n");
+	assert(test_lazy_init_untouched());
+	assert(test_lazy_malloc_order());
+	assert(test_lazy_exhaustion());
+	assert(test_lazy_instance_untouched());
+	printf("Tests 38-41: PASS\n\n");
+
+	printf("Tests 42-44: Non-uniform pool sizing\n");
+	assert(test_layout_weighted());
+	assert(test_layout_counted());
+	assert(test_layout_invalid_config());
+	printf("Tests 42-44: PASS\n\n");
+
+	printf("Tests 45-48: Spill policy\n");
+	assert(test_spill_any());
+	assert(test_spill_next());
+	assert(test_spill_none());
+	assert(test_spill_invalid_policy());
+	printf("Tests 45-48: PASS\n\n");
+
+	printf("Tests 49-52: Pool growth\n");
+	assert(test_growth_parent_slabs());
+	assert(test_growth_mmap_slab());
+	assert(test_growth_acquire_failure());
+	assert(test_growth_invalid_config());
+	printf("Tests 49-52: PASS\n\n");
+
+	printf("Tests 53-56: Page aligned and mapped heaps\n");
+	assert(test_map_page_aligned_instance());
+	assert(test_map_heap());
+	assert(test_map_huge_pages());
+	assert(test_map_trim_unused_pools());
+	printf("Tests 53-56: PASS\n\n");
+
+	printf("Tests 57-60: Aligned allocation\n");
+	assert(test_aligned_cache_line_blocks());
+	assert(test_aligned_malloc_pool_choice());
+	assert(test_aligned_malloc_invalid());
+	assert(test_aligned_malloc_unsatisfiable());
+	printf("Tests 57-60: PASS\n\n");
+
+	printf("Tests 61-64: Bulk allocation\n");
+	assert(test_bulk_malloc_order());
+	assert(test_bulk_free_reuse());
+	assert(test_bulk_spill());
+	assert(test_bulk_concurrent());
+	printf("Tests 61-64: PASS\n\n");
+
+	printf("Tests 65-66: Sized free\n");
+	assert(test_sized_free_reuse());
+	assert(test_sized_free_spilled());
+	printf("Tests 65-66: PASS\n\n");
+
+	printf("Tests 67-70: Realloc\n");
+	assert(test_realloc_in_place());
+	assert(test_realloc_migrates());
+	assert(test_realloc_exhausted());
+	assert(test_realloc_usable_size());
+	printf("Tests 67-70: PASS\n\n");
+
+	printf("Tests 71-74: Statistics\n");
+	assert(test_stats_usage());
+	assert(test_stats_failures());
+	assert(test_stats_slabs());
+	assert(test_stats_dump());
+	printf("Tests 71-74: PASS\n\n");
+
+	printf("Tests 75-78: Quarter power size classes\n");
+	assert(test_classes_inputs());
+	assert(test_classes_fit());
+	assert(test_classes_alignment());
+	assert(test_classes_utilization());
+	printf("Tests 75-78: PASS\n\n");
+
+	printf("Tests 79-83: Profiling and tuning\n");
+	assert(test_profile_record());
+	assert(test_profile_save_load());
+	assert(test_tune_fit());
+	assert(test_tune_budget());
+	assert(test_tune_merge_decision());
+	printf("Tests 79-83: PASS\n\n");
+
+	printf("Tests 84-87: Rebalancing\n");
+	assert(test_rebalance_inputs());
+	assert(test_rebalance_reassign());
+	assert(test_rebalance_policies());
+	assert(test_rebalance_bulk());
+	printf("Tests 84-87: PASS\n\n");
+
+	printf("Tests 88-91: Bitmap tracking\n");
+	assert(test_bitmap_inputs());
+	assert(test_bitmap_address_order());
+	assert(test_bitmap_double_free());
+	assert(test_bitmap_visit_live());
+	printf("Tests 88-91: PASS\n\n");
+
+	printf("Tests 92-95: NUMA arenas\n");
+	assert(test_numa_inputs());
+	assert(test_numa_local_allocation());
+	assert(test_numa_home_free());
+	assert(test_numa_online_nodes());
+	printf("Tests 92-95: PASS\n\n");
 
 	printf("All tests passed\n");
 }
@@ -205,6 +364,12 @@ bool test_inputs_exceed_single(void) {
 	return verify_heap_inputs(block_sizes, 1);
 }
 
+bool test_inputs_unordered_multiple(void) {
+	size_t descending[] = {32, 16};
+	size_t repeated[] = {16, 16};
+	return verify_heap_inputs(descending, 2) || verify_heap_inputs(repeated, 2);
+}
+
 /* END Heap Inputs Verification Tests */
 
 
@@ -238,7 +403,7 @@ bool test_pool_init_large_single(void) {
 }
 
 bool test_pool_init_large_multiple(void) {
-	size_t block_sizes[] = {32768, 16384};
+	size_t block_sizes[] = {16384, 32768};
 	return pool_init_base(block_sizes, 2);
 }
 
@@ -489,4 +654,2636 @@ bool test_pool_free_multiple() {
 	return pass; 
 }
 
+bool test_pool_free_owner_lookup(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {2, 128, 1024, 16384};
+	pass &= pool_init_base(block_sizes, 4);
+
+	// Free the last block of every pool, each must return to its own pool
+	for(size_t i = 0; i < 4; i++) {
+		uint32_t last_block = pool_controller.pool_end_indices[i];
+		pool_free(&g_pool_heap[last_block]);
+		if(pool_controller.pool_allocators[i] != last_block) {
+			pass = false; 
+		}
+	}
+
+	return pass; 
+}
+
+bool test_pool_free_owner_lookup_non_pow2(void) {
+	bool pass = true; 
+
+	// Three pools cannot be located with a shift. Pool ends are not block
+	// aligned here, so the default heap layout checks do not apply.
+	size_t block_sizes[] = {4, 16, 64};
+	pool_deinit();
+	pass &= pool_init(block_sizes, 3);
+
+	for(size_t i = 0; i < 3; i++) {
+		uint16_t pool_begin = pool_controller.pool_begin_indices[i];
+		pool_free(&g_pool_heap[pool_begin + block_sizes[i]]);
+		pool_free(&g_pool_heap[pool_begin]);
+		if(pool_controller.pool_allocators[i] != pool_begin) {
+			pass = false; 
+		}
+	}
+
+	return pass; 
+}
+
 /* END Pool Free Tests */
+
+
+/* BEGIN Size Class Lookup Tests */
+
+bool test_size_class_boundaries(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {2, 8, 64, 1024};
+	pass &= pool_init_base(block_sizes, 4);
+
+	// Each request lands in the smallest pool whose blocks fit it
+	size_t sizes[] = {0, 1, 2, 3, 8, 9, 64, 65, 1024};
+	size_t pools[] = {0, 0, 0, 1, 1, 2, 2,  3,  3};
+	for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		uint8_t* ptr = pool_malloc(sizes[i]);
+		uint16_t pool_begin = pool_controller.pool_begin_indices[pools[i]];
+		uint32_t pool_end = pool_controller.pool_end_indices[pools[i]];
+		if((ptr < &g_pool_heap[pool_begin]) || (ptr > &g_pool_heap[pool_end])) {
+			pass = false; 
+		}
+	}
+
+	return pass; 
+}
+
+bool test_size_class_oversized(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {8, 16};
+	pass &= pool_init_base(block_sizes, 2);
+
+	// Requests larger than every block size must fail without touching pools
+	if(pool_malloc(17) || pool_malloc(SIZE_MAX)) {
+		pass = false; 
+	}
+	if((pool_controller.pool_allocators[0] != 0) ||
+	   (pool_controller.pool_allocators[1] != HEAP_SIZE/2)) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+bool test_size_class_spill(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {16384, 32768};
+	pass &= pool_init_base(block_sizes, 2);
+
+	// Fill pool 0, the next request must spill into pool 1
+	pool_malloc(16384);
+	pool_malloc(16384);
+	uint8_t* spilled = pool_malloc(1);
+	if(spilled != &g_pool_heap[HEAP_SIZE/2]) {
+		pass = false; 
+	}
+
+	// Freeing a block in pool 0 makes it the first choice again
+	pool_free(&g_pool_heap[0]);
+	if(pool_malloc(1) != &g_pool_heap[0]) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+/* END Size Class Lookup Tests */
+
+
+/* BEGIN Event Trace Tests */
+
+void trace_count_hook(const pool_event_t* event, void* ctx) {
+	size_t* counts = ctx;
+	counts[event->type]++;
+}
+
+bool test_trace_events(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {16384};
+	pass &= pool_init_base(block_sizes, 1);
+
+	size_t counts[POOL_EVENT_MALLOC_FAILED + 1] = {0};
+	pool_set_event_hook(trace_count_hook, counts);
+
+	uint8_t* ptr = NULL;
+	for(size_t i = 0; i < 5; i++) {
+		ptr = pool_malloc(16384); // Last call fails
+	}
+	pool_free(&g_pool_heap[0]);
+	pool_set_event_hook(NULL, NULL);
+
+	// Expected event counts depend on the compiled trace level
+	size_t expected_failed = (POOL_TRACE_LEVEL >= 1) ? 1 : 0;
+	size_t expected_other  = (POOL_TRACE_LEVEL >= 2) ? 1 : 0;
+	if((counts[POOL_EVENT_MALLOC] != 4 * expected_other) ||
+	   (counts[POOL_EVENT_POOL_FULL] != expected_other) ||
+	   (counts[POOL_EVENT_FREE] != expected_other) ||
+	   (counts[POOL_EVENT_MALLOC_FAILED] != expected_failed) || ptr) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+/* END Event Trace Tests */
+
+
+/* BEGIN Thread Cache Tests */
+
+#if POOL_DEBUG
+bool debug_aborts(void (*fn)(void)) {
+	fflush(stdout);
+	pid_t pid = fork();
+	if(!pid) {
+		// Keep the expected assertion message out of the test output
+		freopen("/dev/null", "w", stderr);
+		fn();
+		_exit(0);
+	}
+	int status;
+	return (pid > 0) && (waitpid(pid, &status, 0) == pid) && WIFSIGNALED(status) &&
+	       (WTERMSIG(status) == SIGABRT);
+}
+#endif
+
+#if POOL_THREAD_SAFE || POOL_LOCK_FREE
+size_t count_free_blocks(size_t n) {
+	size_t count = 0;
+	while(pool_malloc(n)) {
+		count++;
+	}
+	return count;
+}
+
+void* cache_worker(void* arg) {
+	cache_worker_t* worker = arg;
+	for(size_t i = 0; i < 8; i++) {
+		void* ptr = worker->pool ? pool_malloc_from(worker->pool, 16) : pool_malloc(16);
+		if(worker->pool) {
+			pool_free_to(worker->pool, ptr);
+		}
+		else {
+			pool_free(ptr);
+		}
+	}
+	if(worker->flush) {
+		pool_thread_cache_flush();
+	}
+	pthread_barrier_wait(worker->barrier);
+	pthread_barrier_wait(worker->barrier);
+	return NULL;
+}
+#endif
+
+#if POOL_THREAD_SAFE
+
+bool test_thread_cache_reuse(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {8};
+	pass &= pool_init_base(block_sizes, 1);
+
+	// First allocation moves a whole batch into the thread's magazine
+	uint8_t* ptr1 = pool_malloc(8);
+	if(pool_controller.pool_allocators[0] != 8 * POOL_TCACHE_BATCH) {
+		pass = false; 
+	}
+
+	// Free and re-allocate without touching the shared pool
+	pool_free(ptr1);
+	uint8_t* ptr2 = pool_malloc(8);
+	if((ptr2 != ptr1) || (pool_controller.pool_allocators[0] != 8 * POOL_TCACHE_BATCH)) {
+		pass = false; 
+	}
+
+	// Flushing returns the remaining cached blocks
+	pool_free(ptr2);
+	pool_thread_cache_flush();
+	if(pool_controller.pool_allocators[0] != 0) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+void* thread_cache_exit_worker(void* arg) {
+	(void)arg;
+	void* ptrs[16];
+	for(size_t i = 0; i < 16; i++) {
+		ptrs[i] = pool_malloc(1024);
+	}
+	for(size_t i = 0; i < 16; i++) {
+		pool_free(ptrs[i]);
+	}
+	return NULL;
+}
+
+#if POOL_DEBUG
+// Destroys an instance another thread still caches blocks of
+static void thread_cache_destroy_bound(void) {
+	size_t block_sizes[] = {16, 64};
+	pool_config_t config = {.block_sizes = block_sizes, .block_size_count = 2};
+	pthread_barrier_t barrier;
+	pthread_barrier_init(&barrier, NULL, 2);
+	cache_worker_t worker = {pool_map(16384, &config, 0), &barrier, false};
+	pthread_t thread;
+	pthread_create(&thread, NULL, cache_worker, &worker);
+	pthread_barrier_wait(&barrier);
+	pool_destroy(worker.pool);
+}
+#endif
+
+bool test_thread_cache_exit_flush(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {1024};
+	pass &= pool_init_base(block_sizes, 1);
+
+	// Exiting threads must hand their cached blocks back
+	pthread_t threads[4];
+	for(size_t i = 0; i < 4; i++) {
+		pthread_create(&threads[i], NULL, thread_cache_exit_worker, NULL);
+	}
+	for(size_t i = 0; i < 4; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	if(count_free_blocks(1024) != HEAP_SIZE / 1024) {
+		pass = false; 
+	}
+
+	// A thread that flushed may exit after its instance was destroyed
+	size_t instance_sizes[] = {16, 64};
+	pool_config_t config = {.block_sizes = instance_sizes, .block_size_count = 2};
+	pthread_barrier_t barrier;
+	pthread_barrier_init(&barrier, NULL, 2);
+	cache_worker_t worker = {pool_map(16384, &config, 0), &barrier, true};
+	if(!worker.pool) {
+		return false;
+	}
+	pthread_t thread;
+	pthread_create(&thread, NULL, cache_worker, &worker);
+	pthread_barrier_wait(&barrier);
+	pool_destroy(worker.pool);
+	pthread_barrier_wait(&barrier);
+	pthread_join(thread, NULL);
+	pthread_barrier_destroy(&barrier);
+
+#if POOL_DEBUG
+	// Unless it flushed first
+	pass &= debug_aborts(thread_cache_destroy_bound);
+#endif
+
+	return pass; 
+}
+
+void* thread_cache_stress_worker(void* arg) {
+	uintptr_t id = (uintptr_t)arg;
+	uint8_t* live[64] = {0};
+	uint32_t seed = id + 1;
+	uintptr_t errors = 0;
+
+	for(size_t i = 0; i < 100000; i++) {
+		seed = seed * 1103515245 + 12345;
+		size_t slot = (seed >> 16) % 64;
+
+		if(live[slot]) {
+			// Block must still hold this thread's stamp
+			if(live[slot][2] != (uint8_t)id || live[slot][3] != (uint8_t)slot) {
+				errors++;
+			}
+			pool_free(live[slot]);
+			live[slot] = NULL;
+		}
+		else if((live[slot] = pool_malloc(4 + (seed >> 8) % 60))) {
+			live[slot][2] = (uint8_t)id;
+			live[slot][3] = (uint8_t)slot;
+		}
+	}
+	for(size_t slot = 0; slot < 64; slot++) {
+		pool_free(live[slot]);
+	}
+	return (void*)errors;
+}
+
+bool test_thread_cache_stress(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {16, 64};
+	pass &= pool_init_base(block_sizes, 2);
+
+	pthread_t threads[8];
+	for(uintptr_t i = 0; i < 8; i++) {
+		pthread_create(&threads[i], NULL, thread_cache_stress_worker, (void*)i);
+	}
+	for(size_t i = 0; i < 8; i++) {
+		void* errors;
+		pthread_join(threads[i], &errors);
+		if(errors) {
+			pass = false; 
+		}
+	}
+
+	// Every block is back in the shared pools once all threads exit
+	pool_thread_cache_flush();
+	if(count_free_blocks(1) != HEAP_SIZE / 2 / 16 + HEAP_SIZE / 2 / 64) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+#endif
+
+/* END Thread Cache Tests */
+
+
+/* BEGIN Lock-Free Free List Tests */
+
+#if POOL_LOCK_FREE
+bool test_lock_free_tagged_head(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {8};
+	pass &= pool_init_base(block_sizes, 1);
+
+	uint64_t head = atomic_load(&pool_controller.pool_heads[0]);
+	if((POOL_HEAD_INDEX(head) != 0) || (POOL_HEAD_TAG(head) != 0)) {
+		pass = false; 
+	}
+
+	// Popping and pushing back the same block restores the index,
+	// but not the tag, so stale swaps cannot succeed
+	uint8_t* ptr = pool_malloc(8);
+	if(POOL_HEAD_INDEX(atomic_load(&pool_controller.pool_heads[0])) != 8) {
+		pass = false; 
+	}
+	pool_free(ptr);
+	head = atomic_load(&pool_controller.pool_heads[0]);
+	if((POOL_HEAD_INDEX(head) != 0) || (POOL_HEAD_TAG(head) != 2)) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+static pthread_barrier_t lock_free_barrier;
+static uint8_t* lock_free_slots[4][32];
+
+void* lock_free_cross_thread_worker(void* arg) {
+	uintptr_t id = (uintptr_t)arg;
+	uintptr_t errors = 0;
+
+	for(size_t round = 0; round < 2000; round++) {
+		// Allocate and stamp a batch of blocks
+		for(size_t i = 0; i < 32; i++) {
+			uint8_t* ptr = pool_malloc(4 + (i * 7 + round) % 60);
+			if(ptr) {
+				ptr[2] = (uint8_t)id;
+				ptr[3] = (uint8_t)i;
+			}
+			lock_free_slots[id][i] = ptr;
+		}
+		pthread_barrier_wait(&lock_free_barrier);
+
+		// Free the neighbouring thread's batch
+		uintptr_t owner = (id + 1) % 4;
+		for(size_t i = 0; i < 32; i++) {
+			uint8_t* ptr = lock_free_slots[owner][i];
+			if(ptr && ((ptr[2] != (uint8_t)owner) || (ptr[3] != (uint8_t)i))) {
+				errors++;
+			}
+			pool_free(ptr);
+		}
+		pthread_barrier_wait(&lock_free_barrier);
+	}
+	return (void*)errors;
+}
+
+bool test_lock_free_cross_thread_free(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {16, 64};
+	pass &= pool_init_base(block_sizes, 2);
+
+	pthread_barrier_init(&lock_free_barrier, NULL, 4);
+	pthread_t threads[4];
+	for(uintptr_t i = 0; i < 4; i++) {
+		pthread_create(&threads[i], NULL, lock_free_cross_thread_worker, (void*)i);
+	}
+	for(size_t i = 0; i < 4; i++) {
+		void* errors;
+		pthread_join(threads[i], &errors);
+		if(errors) {
+			pass = false; 
+		}
+	}
+	pthread_barrier_destroy(&lock_free_barrier);
+
+	// Every block was returned exactly once
+	if(count_free_blocks(1) != HEAP_SIZE / 2 / 16 + HEAP_SIZE / 2 / 64) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+#endif
+
+/* END Lock-Free Free List Tests */
+
+
+/* BEGIN Allocator Instance Tests */
+
+bool test_instance_separate_heaps(void) {
+	bool pass = true; 
+
+	static uint8_t buffer1[8192], buffer2[8192];
+	size_t block_sizes[] = {16, 256};
+	pool_allocator_t* pool1 = pool_create(buffer1, sizeof(buffer1), block_sizes, 2);
+	pool_allocator_t* pool2 = pool_create(buffer2, sizeof(buffer2), block_sizes, 2);
+	if(!pool1 || !pool2) {
+		return false;
+	}
+
+	// Each instance serves from its own buffer
+	uint8_t* ptr1 = pool_malloc_from(pool1, 16);
+	uint8_t* ptr2 = pool_malloc_from(pool2, 200);
+	if((ptr1 < buffer1) || (ptr1 >= buffer1 + sizeof(buffer1)) ||
+	   (ptr2 < buffer2) || (ptr2 >= buffer2 + sizeof(buffer2))) {
+		pass = false; 
+	}
+	if((ptr1 < pool1->heap) || (ptr2 < pool2->heap + pool2->pool_size)) {
+		pass = false; 
+	}
+
+	// Freed blocks are reused by their own instance
+	pool_free_to(pool1, ptr1);
+	pool_free_to(pool2, ptr2);
+	if((pool_malloc_from(pool1, 16) != ptr1) || (pool_malloc_from(pool2, 200) != ptr2)) {
+		pass = false; 
+	}
+
+	pool_destroy(pool1);
+	pool_destroy(pool2);
+	return pass; 
+}
+
+bool test_instance_invalid_inputs(void) {
+	bool pass = true; 
+
+	static uint8_t buffer[2 * 65536];
+	size_t block_sizes[] = {16, 256};
+	size_t tiny_block_sizes[] = {1};
+
+	if(pool_create(NULL, sizeof(buffer), block_sizes, 2) ||
+	   pool_create(buffer, sizeof(pool_allocator_t), block_sizes, 2) ||
+	   pool_create(buffer, 4096, tiny_block_sizes, 1) ||
+	   pool_create(buffer, 4096, block_sizes, 0)) {
+		pass = false; 
+	}
+
+	// 16-bit links cannot index past 64 KiB
+	if((POOL_LINK_BITS == 16) && pool_create(buffer, sizeof(buffer), block_sizes, 2)) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+bool test_instance_exhaustion_isolated(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {8};
+	pass &= pool_init_base(block_sizes, 1);
+
+	static uint8_t buffer[8192];
+	size_t instance_block_sizes[] = {1024};
+	pool_allocator_t* pool = pool_create(buffer, sizeof(buffer), instance_block_sizes, 1);
+	if(!pool) {
+		return false;
+	}
+
+	// Exhausting an instance leaves the global heap untouched
+	size_t count = 0;
+	while(pool_malloc_from(pool, 1024)) {
+		count++;
+	}
+	if((count != pool->heap_size / 1024) || !pool_malloc(8)) {
+		pass = false; 
+	}
+
+	pool_destroy(pool);
+	return pass; 
+}
+
+/* END Allocator Instance Tests */
+
+
+/* BEGIN Link Width Tests */
+
+#if POOL_LINK_BITS > 16
+bool test_link_wide_instance(void) {
+	bool pass = true; 
+
+	// A heap far beyond the reach of 16-bit links
+	size_t size = 4 << 20;
+	uint8_t* buffer = malloc(size);
+	size_t block_sizes[] = {64, 4096, 65536, 1 << 19};
+	pool_allocator_t* pool = pool_create(buffer, size, block_sizes, 4);
+	if(!pool) {
+		free(buffer);
+		return false;
+	}
+
+	// Drain the first pool, its blocks span well past index 65535
+	size_t count = 0;
+	uint8_t* ptr = NULL;
+	uint8_t* last = NULL;
+	while((ptr = pool_malloc_from(pool, 64)) && (ptr < pool->heap + pool->pool_size)) {
+		last = ptr;
+		count++;
+	}
+	if((count != pool->pool_size / 64) || ((size_t)(last - pool->heap) <= 65535)) {
+		pass = false; 
+	}
+
+	// Freeing the last block makes it the next allocation
+	pool_free_to(pool, last);
+	if(pool_malloc_from(pool, 64) != last) {
+		pass = false; 
+	}
+
+	pool_destroy(pool);
+	free(buffer);
+	return pass; 
+}
+#endif
+
+/* END Link Width Tests */
+
+
+/* BEGIN Lazy Initialization Tests */
+
+bool lazy_init_base(const size_t* block_sizes, size_t block_size_count) {
+	pool_deinit(); // Zero global static heap object
+
+	pool_config_t config = {
+		.block_sizes = block_sizes,
+		.block_size_count = block_size_count,
+		.lazy = true
+	};
+	return pool_init_ex(&config);
+}
+
+bool test_lazy_init_untouched(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {8, 1024};
+	pass &= lazy_init_base(block_sizes, 2);
+
+	// No block is linked up front
+	for(size_t i = 0; i < HEAP_SIZE; i++) {
+		if(g_pool_heap[i]) {
+			pass = false; 
+		}
+	}
+	if((pool_controller.pool_allocators[0] != POOL_NULL_LINK) ||
+	   (pool_controller.pool_bumps[1] != HEAP_SIZE/2)) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+bool test_lazy_malloc_order(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {8, 1024};
+	pass &= lazy_init_base(block_sizes, 2);
+
+	// Never-used blocks are handed out in address order
+	uint8_t* ptr1 = pool_malloc(8);
+	uint8_t* ptr2 = pool_malloc(8);
+	uint8_t* ptr3 = pool_malloc(1000);
+	if((ptr1 != &g_pool_heap[0]) || (ptr2 != &g_pool_heap[8]) ||
+	   (ptr3 != &g_pool_heap[HEAP_SIZE/2])) {
+		pass = false; 
+	}
+
+	// Freed blocks are reused before never-used ones
+	pool_free(ptr1);
+	if(pool_malloc(8) != ptr1) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+bool test_lazy_exhaustion(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {16384};
+	pass &= lazy_init_base(block_sizes, 1);
+
+	uint8_t* ptrs[4];
+	for(size_t i = 0; i < 4; i++) {
+		ptrs[i] = pool_malloc(16384);
+		if(ptrs[i] != &g_pool_heap[16384 * i]) {
+			pass = false; 
+		}
+	}
+	if(pool_malloc(16384)) {
+		pass = false; 
+	}
+
+	// A full lazy pool recovers through its free list
+	pool_free(ptrs[2]);
+	if((pool_malloc(16384) != ptrs[2]) || pool_malloc(16384)) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+bool test_lazy_instance_untouched(void) {
+	bool pass = true; 
+
+	static uint8_t buffer[8192];
+	memset(buffer, 0xAA, sizeof(buffer));
+
+	size_t block_sizes[] = {16, 256};
+	pool_config_t config = {.block_sizes = block_sizes, .block_size_count = 2, .lazy = true};
+	pool_allocator_t* pool = pool_create_ex(buffer, sizeof(buffer), &config);
+	if(!pool) {
+		return false;
+	}
+
+	for(uint8_t* byte = pool->heap; byte < buffer + sizeof(buffer); byte++) {
+		if(*byte != 0xAA) {
+			pass = false; 
+		}
+	}
+	if(pool_malloc_from(pool, 16) != pool->heap) {
+		pass = false; 
+	}
+
+	pool_destroy(pool);
+	return pass; 
+}
+
+/* END Lazy Initialization Tests */
+
+/* BEGIN Non-Uniform Pool Sizing Tests */
+
+bool test_layout_weighted(void) {
+	bool pass = true; 
+
+	pool_deinit(); // Zero global static heap object
+
+	// Seven eighths of the heap for the small blocks
+	size_t block_sizes[] = {8, 1024};
+	size_t weights[] = {7, 1};
+	pool_config_t config = {.block_sizes = block_sizes, .block_size_count = 2, .pool_weights = weights};
+	pass &= pool_init_ex(&config);
+
+	if((pool_controller.pool_begin_indices[1] != HEAP_SIZE/8*7) ||
+	   (pool_controller.pool_end_indices[1] != HEAP_SIZE - 1024) ||
+	   (pool_controller.pool_end_indices[0] != HEAP_SIZE/8*7 - 8)) {
+		pass = false; 
+	}
+
+	uint8_t* ptr1 = pool_malloc(8);
+	uint8_t* ptr2 = pool_malloc(1000);
+	if((ptr1 != &g_pool_heap[0]) || (ptr2 != &g_pool_heap[HEAP_SIZE/8*7])) {
+		pass = false; 
+	}
+
+	// Frees are routed back to the owning pool
+	pool_free(ptr2);
+	pool_free(ptr1);
+	if((pool_malloc(1000) != ptr2) || (pool_malloc(8) != ptr1)) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+bool test_layout_counted(void) {
+	bool pass = true; 
+
+	pool_deinit(); // Zero global static heap object
+
+	// Pool 1 starts on the first owner map page after pool 0's 10 blocks
+	size_t block_sizes[] = {16, 256};
+	size_t counts[] = {10, 4};
+	size_t page_size = 1;
+	while(((HEAP_SIZE - 1) / page_size) >= POOL_OWNER_MAP_SIZE) {
+		page_size <<= 1;
+	}
+	size_t pool1_begin = (160 + page_size - 1) / page_size * page_size;
+	pool_config_t config = {.block_sizes = block_sizes, .block_size_count = 2, .pool_block_counts = counts};
+	pass &= pool_init_ex(&config);
+
+	if((pool_controller.pool_end_indices[0] != 144) ||
+	   (pool_controller.pool_begin_indices[1] != pool1_begin) ||
+	   (pool_controller.pool_end_indices[1] != pool1_begin + 768)) {
+		pass = false; 
+	}
+
+	// Exactly 10 small blocks before spilling into the larger pool
+	uint8_t* ptrs[10];
+	for(size_t i = 0; i < 10; i++) {
+		ptrs[i] = pool_malloc(16);
+		if(ptrs[i] != &g_pool_heap[16 * i]) {
+			pass = false; 
+		}
+	}
+	uint8_t* spilled = pool_malloc(16);
+	if(spilled != &g_pool_heap[pool1_begin]) {
+		pass = false; 
+	}
+
+	// Blocks return to their own pools
+	pool_free(spilled);
+	pool_free(ptrs[3]);
+	if((pool_malloc(16) != ptrs[3]) || (pool_malloc(256) != spilled)) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+bool test_layout_invalid_config(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {16, 256};
+	size_t too_many[] = {HEAP_SIZE/16, 1};
+	size_t no_blocks[] = {4, 0};
+	size_t no_weight[] = {0, 0};
+	size_t weights[] = {1, 1};
+
+	pool_config_t config = {.block_sizes = block_sizes, .block_size_count = 2};
+	config.pool_block_counts = too_many;
+	pass &= !verify_pool_config(HEAP_SIZE, &config);
+	config.pool_block_counts = no_blocks;
+	pass &= !verify_pool_config(HEAP_SIZE, &config);
+	config.pool_block_counts = NULL;
+	config.pool_weights = no_weight;
+	pass &= !verify_pool_config(HEAP_SIZE, &config);
+
+	// A share too small to hold a single block
+	size_t tiny_weights[] = {HEAP_SIZE, 1};
+	config.pool_weights = tiny_weights;
+	pass &= !verify_pool_config(HEAP_SIZE, &config);
+
+	// Weights and counts are mutually exclusive
+	config.pool_weights = weights;
+	config.pool_block_counts = weights;
+	pass &= !verify_pool_config(HEAP_SIZE, &config);
+	config.pool_block_counts = NULL;
+	pass &= verify_pool_config(HEAP_SIZE, &config);
+
+	pool_deinit(); // Zero global static heap object
+	config.pool_weights = no_weight;
+	pass &= !pool_init_ex(&config);
+
+	return pass; 
+}
+
+/* END Non-Uniform Pool Sizing Tests */
+
+
+/* BEGIN Spill Policy Tests */
+
+bool spill_init_base(pool_spill_t spill) {
+	static const size_t block_sizes[] = {16, 64, 256};
+	static const size_t counts[] = {2, 1, 4};
+
+	pool_deinit(); // Zero global static heap object
+
+	pool_config_t config = {
+		.block_sizes = block_sizes,
+		.block_size_count = 3,
+		.pool_block_counts = counts,
+		.spill = spill
+	};
+	return pool_init_ex(&config);
+}
+
+bool test_spill_any(void) {
+	bool pass = true; 
+
+	pass &= spill_init_base(POOL_SPILL_ANY);
+
+	uint8_t* ptr1 = pool_malloc(16);
+	uint8_t* ptr2 = pool_malloc(16);
+	uint8_t* ptr3 = pool_malloc(16);
+	uint8_t* ptr4 = pool_malloc(16);
+	if(!ptr1 || !ptr2 ||
+	   (ptr3 != &g_pool_heap[pool_controller.pool_begin_indices[1]]) ||
+	   (ptr4 != &g_pool_heap[pool_controller.pool_begin_indices[2]])) {
+		pass = false; 
+	}
+
+	// Both spills are charged to the 16 byte pool
+	if((pool_controller.spill_counts[0] != 2) ||
+	   (pool_controller.spill_bytes[0] != (64 - 16) + (256 - 16)) ||
+	   pool_controller.spill_counts[1] || pool_controller.spill_counts[2]) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+bool test_spill_next(void) {
+	bool pass = true; 
+
+	pass &= spill_init_base(POOL_SPILL_NEXT);
+
+	pool_malloc(16);
+	pool_malloc(16);
+	uint8_t* ptr = pool_malloc(16);
+	if((ptr != &g_pool_heap[pool_controller.pool_begin_indices[1]]) || pool_malloc(16)) {
+		pass = false; 
+	}
+	if((pool_controller.spill_counts[0] != 1) || (pool_controller.spill_bytes[0] != 64 - 16)) {
+		pass = false; 
+	}
+
+	// Larger requests still spill as far as their own next pool
+	if(pool_malloc(64) != &g_pool_heap[pool_controller.pool_begin_indices[2]]) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+bool test_spill_none(void) {
+	bool pass = true; 
+
+	pass &= spill_init_base(POOL_SPILL_NONE);
+
+	pool_malloc(16);
+	pool_malloc(16);
+	if(pool_malloc(16) || pool_controller.spill_counts[0]) {
+		pass = false; 
+	}
+	if(pool_malloc(64) != &g_pool_heap[pool_controller.pool_begin_indices[1]]) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+bool test_spill_invalid_policy(void) {
+	size_t block_sizes[] = {16, 64};
+	pool_config_t config = {.block_sizes = block_sizes, .block_size_count = 2};
+	config.spill = POOL_SPILL_NONE + 1;
+	return !verify_pool_config(HEAP_SIZE, &config);
+}
+
+/* END Spill Policy Tests */
+
+
+/* BEGIN Pool Growth Tests */
+
+static size_t growth_acquire_calls;
+
+void* growth_acquire_none(size_t size, void* ctx) {
+	(void)size;
+	(void)ctx;
+	growth_acquire_calls++;
+	return NULL;
+}
+
+void growth_release_none(void* slab, size_t size, void* ctx) {
+	(void)slab;
+	(void)size;
+	(void)ctx;
+}
+
+bool test_growth_parent_slabs(void) {
+#if POOL_LOCK_FREE
+	return true;
+#else
+	bool pass = true; 
+
+	static uint8_t parent_buffer[16384];
+	static uint8_t buffer[8192];
+	size_t parent_block_sizes[] = {2048};
+	pool_allocator_t* parent = pool_create(parent_buffer, sizeof(parent_buffer), parent_block_sizes, 1);
+
+	// Two blocks in the heap, four more per slab
+	size_t block_sizes[] = {512};
+	size_t counts[] = {2};
+	pool_config_t config = {
+		.block_sizes = block_sizes,
+		.block_size_count = 1,
+		.pool_block_counts = counts,
+		.slab_acquire = pool_slab_acquire_parent,
+		.slab_release = pool_slab_release_parent,
+		.slab_ctx = parent,
+		.slab_size = 2048
+	};
+	pool_allocator_t* pool = pool_create_ex(buffer, sizeof(buffer), &config);
+	if(!parent || !pool) {
+		return false;
+	}
+
+	uint8_t* ptrs[7];
+	for(size_t i = 0; i < 7; i++) {
+		ptrs[i] = pool_malloc_from(pool, 512);
+	}
+	if((ptrs[0] != pool->heap) || (ptrs[1] != pool->heap + 512)) {
+		pass = false; 
+	}
+
+	// Blocks 2-5 fill the first slab, block 6 starts a second one
+	for(size_t i = 2; i < 7; i++) {
+		if((ptrs[i] < parent->heap) || (ptrs[i] >= parent->heap + parent->heap_size)) {
+			pass = false; 
+		}
+	}
+	if((ptrs[3] != ptrs[2] + 512) || (pool->slab_used != 0x3)) {
+		pass = false; 
+	}
+
+	// Freed slab blocks are reused, and empty slabs go back to the parent
+	pool_free_to(pool, ptrs[4]);
+	if(pool_malloc_from(pool, 512) != ptrs[4]) {
+		pass = false; 
+	}
+	pool_free_to(pool, ptrs[6]);
+	if((pool_trim(pool) != 1) || (pool->slab_used != 0x1)) {
+		pass = false; 
+	}
+	for(size_t i = 2; i < 6; i++) {
+		pool_free_to(pool, ptrs[i]);
+	}
+	if((pool_trim(pool) != 1) || pool->slab_used) {
+		pass = false; 
+	}
+
+	pool_destroy(pool);
+	pool_destroy(parent);
+	return pass; 
+#endif
+}
+
+bool test_growth_mmap_slab(void) {
+#if POOL_LOCK_FREE
+	return true;
+#else
+	bool pass = true; 
+
+	static uint8_t buffer[8192];
+	size_t block_sizes[] = {64};
+	size_t counts[] = {1};
+	pool_config_t config = {
+		.block_sizes = block_sizes,
+		.block_size_count = 1,
+		.pool_block_counts = counts,
+		.slab_acquire = pool_slab_acquire_mmap,
+		.slab_release = pool_slab_release_mmap,
+		.slab_size = 4096
+	};
+	pool_allocator_t* pool = pool_create_ex(buffer, sizeof(buffer), &config);
+	if(!pool) {
+		return false;
+	}
+
+	uint8_t* ptr1 = pool_malloc_from(pool, 64);
+	uint8_t* ptr2 = pool_malloc_from(pool, 64);
+	if((ptr1 != pool->heap) || !ptr2 || (ptr2 == ptr1 + 64)) {
+		pass = false; 
+	}
+	memset(ptr2, 0xAA, 64);
+
+	pool_free_to(pool, ptr2);
+	if(pool_trim(pool) != 1) {
+		pass = false; 
+	}
+
+	pool_destroy(pool);
+	return pass; 
+#endif
+}
+
+bool test_growth_acquire_failure(void) {
+	bool pass = true; 
+
+	pool_deinit(); // Zero global static heap object
+
+	// Growth is tried before spilling, and spilling still applies if it fails
+	size_t block_sizes[] = {16, 64};
+	size_t counts[] = {1, 1};
+	pool_config_t config = {
+		.block_sizes = block_sizes,
+		.block_size_count = 2,
+		.pool_block_counts = counts,
+		.slab_acquire = growth_acquire_none,
+		.slab_release = growth_release_none,
+		.slab_size = 1024
+	};
+	if(!pool_init_ex(&config)) {
+		return POOL_LOCK_FREE;
+	}
+
+	growth_acquire_calls = 0;
+	uint8_t* ptr1 = pool_malloc(16);
+	uint8_t* ptr2 = pool_malloc(16);
+	uint8_t* ptr3 = pool_malloc(16);
+	if((ptr1 != &g_pool_heap[0]) ||
+	   (ptr2 != &g_pool_heap[pool_controller.pool_begin_indices[1]]) || ptr3) {
+		pass = false; 
+	}
+	if(growth_acquire_calls != 2) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+bool test_growth_invalid_config(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {16, 1024};
+	pool_config_t config = {
+		.block_sizes = block_sizes,
+		.block_size_count = 2,
+		.slab_acquire = growth_acquire_none,
+		.slab_release = growth_release_none,
+		.slab_size = 1024
+	};
+	pass &= (verify_pool_config(HEAP_SIZE, &config) == !POOL_LOCK_FREE);
+
+	// Slabs must hold the largest block
+	config.slab_size = 512;
+	pass &= !verify_pool_config(HEAP_SIZE, &config);
+
+	// Slabs must be returnable
+	config.slab_size = 1024;
+	config.slab_release = NULL;
+	pass &= !verify_pool_config(HEAP_SIZE, &config);
+
+	return pass; 
+}
+
+/* END Pool Growth Tests */
+
+
+/* BEGIN Mapped Heap Tests */
+
+bool test_map_page_aligned_instance(void) {
+	bool pass = true; 
+
+	static uint8_t buffer[32768];
+	size_t block_sizes[] = {16, 256, 1024};
+	pool_config_t config = {.block_sizes = block_sizes, .block_size_count = 3, .page_size = 4096};
+	pool_allocator_t* pool = pool_create_ex(buffer, sizeof(buffer), &config);
+	if(!pool) {
+		return false;
+	}
+
+	// Evenly sized pools shrink to whole pages
+	if(((uintptr_t)pool->heap % 4096) || (pool->pool_size % 4096) ||
+	   (pool->pool_begin_indices[2] != 2 * pool->pool_size)) {
+		pass = false; 
+	}
+	uint8_t* ptr = pool_malloc_from(pool, 1024);
+	if(ptr != pool->heap + pool->pool_begin_indices[2]) {
+		pass = false; 
+	}
+	pool_free_to(pool, ptr);
+
+	// Page size must be a power of 2
+	config.page_size = 3000;
+	pass &= !pool_create_ex(buffer, sizeof(buffer), &config);
+
+	pool_destroy(pool);
+	return pass; 
+}
+
+bool test_map_heap(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {16, 4096};
+	size_t weights[] = {1, 3};
+	pool_config_t config = {.block_sizes = block_sizes, .block_size_count = 2, .pool_weights = weights};
+	pool_allocator_t* pool = pool_map(POOL_MAX_HEAP_SIZE < (1 << 20) ? POOL_MAX_HEAP_SIZE : (1 << 20),
+	                                  &config, 0);
+	if(!pool) {
+		return false;
+	}
+
+	long page_size = sysconf(_SC_PAGESIZE);
+	if(((uintptr_t)pool->heap % page_size) || (pool->pool_begin_indices[1] % page_size) ||
+	   ((uint8_t*)pool < (uint8_t*)pool->mapping) || (pool->heap <= (uint8_t*)pool)) {
+		pass = false; 
+	}
+
+	uint8_t* ptr1 = pool_malloc_from(pool, 16);
+	uint8_t* ptr2 = pool_malloc_from(pool, 4096);
+	if((ptr1 != pool->heap) || (ptr2 != pool->heap + pool->pool_begin_indices[1])) {
+		pass = false; 
+	}
+	memset(ptr2, 0xAA, 4096);
+	pool_free_to(pool, ptr2);
+	pool_free_to(pool, ptr1);
+
+	pool_destroy(pool);
+	return pass; 
+}
+
+bool test_map_huge_pages(void) {
+	bool pass = true; 
+
+	// Falls back to normal pages on systems without reserved huge pages
+	size_t block_sizes[] = {64};
+	pool_config_t config = {.block_sizes = block_sizes, .block_size_count = 1};
+	pool_allocator_t* pool = pool_map(65536, &config, POOL_MAP_HUGETLB | POOL_MAP_HUGEPAGE);
+	if(!pool || (pool->heap_size < 65536)) {
+		return false;
+	}
+	if(pool_malloc_from(pool, 64) != pool->heap) {
+		pass = false; 
+	}
+
+	pool_destroy(pool);
+	return pass; 
+}
+
+bool test_map_trim_unused_pools(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {64, 1024};
+	pool_config_t config = {.block_sizes = block_sizes, .block_size_count = 2};
+	pool_allocator_t* pool = pool_map(65536, &config, 0);
+	if(!pool) {
+		return false;
+	}
+
+	// Dirty a few pages of each pool, then keep one block of pool 0 in use
+	uint8_t* ptrs[8];
+	for(size_t i = 0; i < 8; i++) {
+		ptrs[i] = pool_malloc_from(pool, (i % 2) ? 1024 : 64);
+		memset(ptrs[i], 0xAA, (i % 2) ? 1024 : 64);
+	}
+	for(size_t i = 1; i < 8; i++) {
+		pool_free_to(pool, ptrs[i]);
+	}
+	pool_thread_cache_flush();
+
+	// Only pool 1 is released, and starts over from its zeroed first block
+	size_t released = pool_trim(pool);
+	if(POOL_LOCK_FREE) {
+		pass &= !released;
+	}
+	else {
+		if((released != 1) || (pool->pool_bumps[1] != pool->pool_begin_indices[1]) ||
+		   (pool->pool_allocators[1] != POOL_NULL_LINK) || (pool->pool_bumps[0] == 0)) {
+			pass = false; 
+		}
+		uint8_t* ptr = pool_malloc_from(pool, 1024);
+		if((ptr != pool->heap + pool->pool_begin_indices[1]) || ptr[1] || ptr[1023]) {
+			pass = false; 
+		}
+		pool_free_to(pool, ptr);
+
+		// Pools already released are not released again
+		pool_free_to(pool, ptrs[0]);
+		pool_thread_cache_flush();
+		if(pool_trim(pool) != 2) {
+			pass = false; 
+		}
+		pass &= !pool_trim(pool);
+	}
+
+	pool_destroy(pool);
+	return pass; 
+}
+
+/* END Mapped Heap Tests */
+
+
+/* BEGIN Aligned Allocation Tests */
+
+bool test_aligned_cache_line_blocks(void) {
+	bool pass = true; 
+
+	// Oddly placed buffer, pools of uneven size
+	static uint8_t buffer[16384 + 1];
+	size_t block_sizes[] = {8, 64, 256};
+	pool_allocator_t* pool = pool_create(buffer + 1, sizeof(buffer) - 1, block_sizes, 3);
+	if(!pool) {
+		return false;
+	}
+
+	for(size_t i = 0; i < 8; i++) {
+		uint8_t* ptr8 = pool_malloc_from(pool, 8);
+		uint8_t* ptr64 = pool_malloc_from(pool, 64);
+		uint8_t* ptr256 = pool_malloc_from(pool, 256);
+		if(((uintptr_t)ptr8 % 8) || ((uintptr_t)ptr64 % POOL_CACHE_LINE) ||
+		   ((uintptr_t)ptr256 % POOL_CACHE_LINE)) {
+			pass = false; 
+		}
+	}
+
+	pool_destroy(pool);
+	return pass; 
+}
+
+bool test_aligned_malloc_pool_choice(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {16, 64, 256, 4096};
+	pass &= pool_init_base(block_sizes, 4);
+
+	// Small requests with large alignment come from larger blocks
+	uint8_t* ptr1 = pool_aligned_malloc(8, 64);
+	uint8_t* ptr2 = pool_aligned_malloc(100, 4096);
+	uint8_t* ptr3 = pool_aligned_malloc(8, 8);
+	if((ptr1 != &g_pool_heap[pool_controller.pool_begin_indices[1]]) ||
+	   (ptr2 != &g_pool_heap[pool_controller.pool_begin_indices[3]]) ||
+	   (ptr3 != &g_pool_heap[0])) {
+		pass = false; 
+	}
+	if(((uintptr_t)ptr1 % 64) || ((uintptr_t)ptr2 % 4096)) {
+		pass = false; 
+	}
+
+	// Aligned blocks are released like any other
+	pool_free(ptr2);
+	if(pool_aligned_malloc(4096, 4096) != ptr2) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+bool test_aligned_malloc_invalid(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {16, 64};
+	pass &= pool_init_base(block_sizes, 2);
+
+	pass &= !pool_aligned_malloc(8, 0);
+	pass &= !pool_aligned_malloc(8, 48);
+
+	return pass; 
+}
+
+bool test_aligned_malloc_unsatisfiable(void) {
+	bool pass = true; 
+
+	// A heap placed one cache line past a page boundary
+	static _Alignas(4096) uint8_t buffer[4 * 4096];
+	size_t block_sizes[] = {1024};
+	size_t counts[] = {4};
+	pool_config_t config = {.block_sizes = block_sizes, .block_size_count = 1, .pool_block_counts = counts};
+	pool_allocator_t* pool = pool_create_ex(buffer + 2 * 4096 - sizeof(pool_allocator_t) + 64,
+	                                        sizeof(pool_allocator_t) + 4096, &config);
+	if(!pool || ((uintptr_t)pool->heap % 4096 != 64)) {
+		return false;
+	}
+
+	pass &= !pool_aligned_malloc_from(pool, 64, 4096);
+	pass &= !pool_aligned_malloc_from(pool, 64, 128);
+	pass &= (pool_aligned_malloc_from(pool, 64, 64) == pool->heap);
+
+	pool_destroy(pool);
+	return pass; 
+}
+
+/* END Aligned Allocation Tests */
+
+
+/* BEGIN Bulk Allocation Tests */
+
+bool test_bulk_malloc_order(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {16, 1024};
+	pass &= pool_init_base(block_sizes, 2);
+
+	// Same blocks, in the same order, as one pool_malloc() each
+	void* ptrs[8];
+	if(pool_malloc_bulk(16, 8, ptrs) != 8) {
+		pass = false; 
+	}
+	for(size_t i = 0; i < 8; i++) {
+		if(ptrs[i] != &g_pool_heap[16 * i]) {
+			pass = false; 
+		}
+	}
+	if(pool_malloc(16) != &g_pool_heap[16 * 8]) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+bool test_bulk_free_reuse(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {16, 1024};
+	pass &= pool_init_base(block_sizes, 2);
+
+	void* ptrs[10];
+	pool_malloc_bulk(16, 8, ptrs);
+	pool_malloc_bulk(1000, 1, &ptrs[8]);
+	ptrs[9] = NULL;
+	pool_free_bulk(ptrs, 10);
+
+	// Freed blocks come back most recently freed first
+	void* again[9];
+	if(pool_malloc_bulk(16, 8, again) != 8) {
+		pass = false; 
+	}
+	for(size_t i = 0; i < 8; i++) {
+		if(again[i] != ptrs[7 - i]) {
+			pass = false; 
+		}
+	}
+	if((pool_malloc_bulk(1000, 1, again) != 1) || (again[0] != ptrs[8])) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+bool test_bulk_spill(void) {
+	bool pass = true; 
+
+	pool_deinit(); // Zero global static heap object
+
+	size_t block_sizes[] = {16, 64};
+	size_t counts[] = {4, 4};
+	pool_config_t config = {.block_sizes = block_sizes, .block_size_count = 2, .pool_block_counts = counts};
+	pass &= pool_init_ex(&config);
+
+	// Past the best fitting pool, requests spill block by block
+	void* ptrs[8];
+	if(pool_malloc_bulk(16, 6, ptrs) != 6) {
+		pass = false; 
+	}
+	if((ptrs[3] != &g_pool_heap[48]) ||
+	   (ptrs[4] != &g_pool_heap[pool_controller.pool_begin_indices[1]]) ||
+	   (pool_controller.spill_counts[0] != 2)) {
+		pass = false; 
+	}
+
+	// Partial batches report how many blocks were allocated
+	if(pool_malloc_bulk(16, 4, ptrs) != 2) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+#if POOL_THREAD_SAFE || POOL_LOCK_FREE
+void* bulk_stress_worker(void* arg) {
+	uintptr_t id = (uintptr_t)arg;
+	uintptr_t errors = 0;
+	void* ptrs[48];
+
+	for(size_t round = 0; round < 2000; round++) {
+		size_t count = pool_malloc_bulk(16, 16 + round % 33, ptrs);
+		for(size_t i = 0; i < count; i++) {
+			((uint8_t*)ptrs[i])[2] = (uint8_t)id;
+			((uint8_t*)ptrs[i])[3] = (uint8_t)i;
+		}
+		for(size_t i = 0; i < count; i++) {
+			if((((uint8_t*)ptrs[i])[2] != (uint8_t)id) || (((uint8_t*)ptrs[i])[3] != (uint8_t)i)) {
+				errors++;
+			}
+		}
+		pool_free_bulk(ptrs, count);
+	}
+	return (void*)errors;
+}
+#endif
+
+bool test_bulk_concurrent(void) {
+#if POOL_THREAD_SAFE || POOL_LOCK_FREE
+	bool pass = true; 
+
+	size_t block_sizes[] = {16, 64};
+	pass &= pool_init_base(block_sizes, 2);
+
+	pthread_t threads[4];
+	for(uintptr_t i = 0; i < 4; i++) {
+		pthread_create(&threads[i], NULL, bulk_stress_worker, (void*)i);
+	}
+	for(size_t i = 0; i < 4; i++) {
+		void* errors;
+		pthread_join(threads[i], &errors);
+		if(errors) {
+			pass = false; 
+		}
+	}
+
+	// Every block was returned exactly once
+	pool_thread_cache_flush();
+	if(count_free_blocks(1) != HEAP_SIZE / 2 / 16 + HEAP_SIZE / 2 / 64) {
+		pass = false; 
+	}
+
+	return pass; 
+#else
+	return true;
+#endif
+}
+
+/* END Bulk Allocation Tests */
+
+
+/* BEGIN Sized Free Tests */
+
+bool test_sized_free_reuse(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {8, 64, 1024, 4096};
+	pass &= pool_init_base(block_sizes, 4);
+
+	uint8_t* ptr1 = pool_malloc(5);
+	uint8_t* ptr2 = pool_malloc(600);
+	pool_free_sized(ptr1, 5);
+	pool_free_sized(ptr2, 600);
+	pool_free_sized(NULL, 8);
+	if((pool_malloc(8) != ptr1) || (pool_malloc(1024) != ptr2)) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+#if POOL_DEBUG
+static void sized_free_mismatch(void) {
+	size_t block_sizes[] = {16, 64};
+	pool_init(block_sizes, 2);
+	pool_free_sized(pool_malloc(16), 64);
+}
+#endif
+
+bool test_sized_free_spilled(void) {
+	bool pass = true; 
+
+	pool_deinit(); // Zero global static heap object
+
+	size_t block_sizes[] = {16, 64};
+	size_t counts[] = {1, 1};
+	pool_config_t config = {.block_sizes = block_sizes, .block_size_count = 2, .pool_block_counts = counts};
+	pass &= pool_init_ex(&config);
+
+	// The second block spilled, its size no longer names its pool
+	uint8_t* ptr1 = pool_malloc(16);
+	uint8_t* ptr2 = pool_malloc(16);
+	pool_free_sized(ptr2, 16);
+	if(pool_malloc(64) != ptr2) {
+		pass = false; 
+	}
+	pool_free_sized(ptr1, 16);
+	if(pool_malloc(16) != ptr1) {
+		pass = false; 
+	}
+
+#if POOL_DEBUG
+	// A size larger than the block is a caller bug, not a spill
+	pass &= debug_aborts(sized_free_mismatch);
+#endif
+
+	return pass; 
+}
+
+/* END Sized Free Tests */
+
+/* BEGIN Realloc Tests */
+
+bool test_realloc_in_place(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {8, 64, 1024, 4096};
+	pass &= pool_init_base(block_sizes, 4);
+
+	// Growing or shrinking within the 64 byte class keeps the block
+	uint8_t* ptr = pool_malloc(40);
+	memset(ptr, 0xAB, 40);
+	if((pool_realloc(ptr, 64) != ptr) || (pool_realloc(ptr, 9) != ptr) || (ptr[39] != 0xAB)) {
+		pass = false; 
+	}
+	if(pool_usable_size(ptr) != 64) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+bool test_realloc_migrates(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {8, 64, 1024, 4096};
+	pass &= pool_init_base(block_sizes, 4);
+
+	uint8_t* ptr = pool_realloc(NULL, 40);
+	for(size_t i = 0; i < 40; i++) {
+		ptr[i] = i;
+	}
+
+	// Outgrown blocks move up, contents follow
+	uint8_t* grown = pool_realloc(ptr, 600);
+	if((grown == ptr) || (pool_usable_size(grown) != 1024)) {
+		pass = false; 
+	}
+	for(size_t i = 0; i < 40; i++) {
+		pass &= (grown[i] == i);
+	}
+
+	// Blocks a smaller pool could hold move down
+	uint8_t* shrunk = pool_realloc(grown, 5);
+	if((pool_usable_size(shrunk) != 8) || memcmp(shrunk, (uint8_t[]){0, 1, 2, 3, 4}, 5)) {
+		pass = false; 
+	}
+
+	// Reallocating to 0 bytes frees
+	if(pool_realloc(shrunk, 0) || (pool_malloc(8) != shrunk)) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+bool test_realloc_exhausted(void) {
+	bool pass = true; 
+
+	pool_deinit(); // Zero global static heap object
+
+	size_t block_sizes[] = {16, 64};
+	size_t counts[] = {1, 1};
+	pool_config_t config = {
+		.block_sizes = block_sizes,
+		.block_size_count = 2,
+		.pool_block_counts = counts,
+		.spill = POOL_SPILL_NONE
+	};
+	pass &= pool_init_ex(&config);
+
+	// A block that cannot grow is left untouched
+	uint8_t* ptr1 = pool_malloc(16);
+	uint8_t* ptr2 = pool_malloc(64);
+	ptr2[0] = 0x5A;
+	if(pool_realloc(ptr1, 64) || (pool_usable_size(ptr1) != 16)) {
+		pass = false; 
+	}
+
+	// A block that cannot shrink stays in place
+	if((pool_realloc(ptr2, 8) != ptr2) || (ptr2[0] != 0x5A)) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+bool test_realloc_usable_size(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {8, 64, 1024, 4096};
+	pass &= pool_init_base(block_sizes, 4);
+
+	uint8_t outside;
+	if(pool_usable_size(NULL) || pool_usable_size(&outside)) {
+		pass = false; 
+	}
+	for(size_t i = 0; i < 4; i++) {
+		pass &= (pool_usable_size(pool_malloc(block_sizes[i] - 1)) == block_sizes[i]);
+	}
+
+#if !POOL_LOCK_FREE
+	// Growth slab blocks report their pool's block size
+	static uint8_t buffer[8192];
+	size_t slab_block_sizes[] = {256};
+	size_t counts[] = {1};
+	pool_config_t config = {
+		.block_sizes = slab_block_sizes,
+		.block_size_count = 1,
+		.pool_block_counts = counts,
+		.slab_acquire = pool_slab_acquire_mmap,
+		.slab_release = pool_slab_release_mmap,
+		.slab_size = 4096
+	};
+	pool_allocator_t* pool = pool_create_ex(buffer, sizeof(buffer), &config);
+	if(!pool) {
+		return false;
+	}
+
+	pool_malloc_from(pool, 256);
+	uint8_t* slab_ptr = pool_malloc_from(pool, 256);
+	uint8_t* moved = pool_realloc_from(pool, slab_ptr, 100);
+	if((pool_usable_size_from(pool, slab_ptr) != 256) || (moved != slab_ptr)) {
+		pass = false; 
+	}
+	pool_destroy(pool);
+#endif
+
+	return pass; 
+}
+
+/* END Realloc Tests */
+
+/* BEGIN Statistics Tests */
+
+bool test_stats_usage(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {8, 64, 1024, 4096};
+	pass &= pool_init_base(block_sizes, 4);
+
+	uint8_t* ptrs[3];
+	for(size_t i = 0; i < 3; i++) {
+		ptrs[i] = pool_malloc(50);
+	}
+	pool_free(ptrs[0]);
+	pool_free(ptrs[1]);
+	pool_free(pool_malloc(5));
+
+	pool_stats_t stats;
+	pool_get_stats(&stats);
+	if((stats.heap_size != HEAP_SIZE) || (stats.num_pools != 4) || stats.unfit) {
+		pass = false; 
+	}
+
+	pool_usage_t* usage = &stats.pools[1];
+	if((usage->block_size != 64) || (usage->blocks != HEAP_SIZE / 4 / 64) || (usage->in_use != 1) ||
+	   (usage->high_water != 3) || (usage->allocs != 3) || (usage->frees != 2) || usage->failures) {
+		pass = false; 
+	}
+	if((stats.pools[0].allocs != 1) || (stats.pools[0].in_use != 0) || stats.pools[2].allocs) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+bool test_stats_failures(void) {
+	bool pass = true; 
+
+	pool_deinit(); // Zero global static heap object
+
+	size_t block_sizes[] = {16, 64};
+	size_t counts[] = {1, 1};
+	pool_config_t config = {.block_sizes = block_sizes, .block_size_count = 2, .pool_block_counts = counts};
+	pass &= pool_init_ex(&config);
+
+	// The second request spills, the third fails and the last fits no pool
+	pool_malloc(16);
+	pool_malloc(16);
+	pool_malloc(16);
+	pool_malloc(100);
+
+	pool_stats_t stats;
+	pool_get_stats(&stats);
+	if((stats.unfit != 1) || (stats.pools[0].failures != 1) || (stats.pools[0].spills != 1) ||
+	   (stats.pools[0].spill_bytes != 48) || (stats.pools[1].in_use != 1) || stats.pools[1].failures) {
+		pass = false; 
+	}
+
+	// Counters restart with each init
+	pass &= pool_init_ex(&config);
+	pool_get_stats(&stats);
+	if(stats.unfit || stats.pools[0].failures || stats.pools[1].allocs || stats.pools[1].high_water) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+bool test_stats_slabs(void) {
+#if POOL_LOCK_FREE
+	return true;
+#else
+	bool pass = true; 
+
+	static uint8_t buffer[8192];
+	size_t block_sizes[] = {256};
+	size_t counts[] = {2};
+	pool_config_t config = {
+		.block_sizes = block_sizes,
+		.block_size_count = 1,
+		.pool_block_counts = counts,
+		.slab_acquire = pool_slab_acquire_mmap,
+		.slab_release = pool_slab_release_mmap,
+		.slab_size = 4096
+	};
+	pool_allocator_t* pool = pool_create_ex(buffer, sizeof(buffer), &config);
+	if(!pool) {
+		return false;
+	}
+
+	// Slab blocks add to the pool's capacity and usage
+	void* ptrs[3];
+	for(size_t i = 0; i < 3; i++) {
+		ptrs[i] = pool_malloc_from(pool, 256);
+	}
+	pool_stats_t stats;
+	pool_get_stats_from(pool, &stats);
+	if((stats.pools[0].slabs != 1) || (stats.pools[0].blocks != 18) || (stats.pools[0].in_use != 3)) {
+		pass = false; 
+	}
+
+	pool_free_to(pool, ptrs[2]);
+	pool_trim(pool);
+	pool_get_stats_from(pool, &stats);
+	if(stats.pools[0].slabs || (stats.pools[0].blocks != 2) || (stats.pools[0].in_use != 2) ||
+	   (stats.pools[0].high_water != 3)) {
+		pass = false; 
+	}
+
+	pool_destroy(pool);
+	return pass; 
+#endif
+}
+
+bool test_stats_dump(void) {
+	bool pass = true; 
+
+	pool_stats_t stats = {.heap_size = 4096, .num_pools = 2, .unfit = 1};
+	stats.pools[0] = (pool_usage_t){.block_size = 8, .blocks = 256, .in_use = 3, .high_water = 4,
+	                                .allocs = 5, .frees = 2, .failures = 0, .spills = 0};
+	stats.pools[1] = (pool_usage_t){.block_size = 2048, .blocks = 1, .allocs = 1, .frees = 1,
+	                                .high_water = 1, .failures = 2};
+
+	char buffer[1024] = {0};
+	FILE* out = fmemopen(buffer, sizeof(buffer), "w");
+	pass &= out && pool_dump_stats(&stats, out);
+	if(out) {
+		fclose(out);
+	}
+
+	const char* expected =
+		"{\"heap_size\":4096,\"num_pools\":2,\"unfit\":1,\"reserve_free\":0,\"double_frees\":0,\"pools\":["
+		"{\"block_size\":8,\"blocks\":256,\"in_use\":3,\"high_water\":4,\"allocs\":5,\"frees\":2,"
+		"\"failures\":0,\"spills\":0,\"spill_bytes\":0,\"slabs\":0},"
+		"{\"block_size\":2048,\"blocks\":1,\"in_use\":0,\"high_water\":1,\"allocs\":1,\"frees\":1,"
+		"\"failures\":2,\"spills\":0,\"spill_bytes\":0,\"slabs\":0}]}\n";
+	if(strcmp(buffer, expected)) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+/* END Statistics Tests */
+
+/* BEGIN Size Class Tests */
+
+bool test_classes_inputs(void) {
+	bool pass = true; 
+
+	// Quarter steps between powers of 2 are accepted
+	size_t quarters[] = {48, 80, 96, 112};
+	size_t small[] = {10, 12, 14, 20};
+	pass &= verify_heap_inputs(quarters, 4);
+	pass &= verify_heap_inputs(small, 4);
+
+	// Sizes in between are not
+	size_t odd[] = {50};
+	size_t eighths[] = {72};
+	pass &= !verify_heap_inputs(odd, 1);
+	pass &= !verify_heap_inputs(eighths, 1);
+
+	return pass; 
+}
+
+bool test_classes_fit(void) {
+	bool pass = true; 
+
+	pool_deinit(); // Zero global static heap object
+
+	size_t block_sizes[] = {16, 48, 80, 112};
+	pass &= pool_init(block_sizes, 4);
+
+	// Every request lands in the smallest block holding it
+	size_t requests[] = {16, 17, 33, 48, 49, 80, 81, 112};
+	size_t expected[] = {16, 48, 48, 48, 80, 80, 112, 112};
+	for(size_t i = 0; i < 8; i++) {
+		uint8_t* ptr = pool_malloc(requests[i]);
+		if(!ptr || (pool_usable_size(ptr) != expected[i])) {
+			pass = false; 
+		}
+		pool_free_sized(ptr, requests[i]);
+	}
+	if(pool_malloc(113)) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+bool test_classes_alignment(void) {
+	bool pass = true; 
+
+	pool_deinit(); // Zero global static heap object
+
+	size_t block_sizes[] = {16, 48, 64, 96};
+	pass &= pool_init(block_sizes, 4);
+
+	// 48 byte blocks are aligned to 16 bytes, 96 byte blocks to 32
+	uint8_t* ptr1 = pool_malloc(40);
+	uint8_t* ptr2 = pool_malloc(40);
+	uint8_t* ptr3 = pool_malloc(90);
+	if((ptr2 - ptr1 != 48) || ((uintptr_t)ptr2 % 16) || ((uintptr_t)ptr3 % 32)) {
+		pass = false; 
+	}
+
+	// Alignments the 48 byte pool cannot meet move up
+	uint8_t* ptr4 = pool_aligned_malloc(40, 32);
+	if((pool_usable_size(ptr4) != 64) || ((uintptr_t)ptr4 % 32)) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+bool test_classes_utilization(void) {
+	bool pass = true; 
+
+	pool_deinit(); // Zero global static heap object
+
+	// 33 byte records fit a third more often in 48 than in 64 byte blocks
+	size_t quarter_sizes[] = {48};
+	size_t power_sizes[] = {64};
+	size_t counts[2] = {0, 0};
+
+	pass &= pool_init(quarter_sizes, 1);
+	while(pool_malloc(33)) {
+		counts[0]++;
+	}
+	pass &= pool_init(power_sizes, 1);
+	while(pool_malloc(33)) {
+		counts[1]++;
+	}
+	if((counts[0] != HEAP_SIZE / 48) || (counts[1] != HEAP_SIZE / 64)) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+/* END Size Class Tests */
+
+/* BEGIN Profile and Tuning Tests */
+
+static pool_profile_t test_profile; 
+
+// Fake block address for profile tests, never dereferenced
+static void* profile_ptr(size_t i) {
+	return (void*)(uintptr_t)(0x100000 + i * 16);
+}
+
+// Peaks of 100 x 24, 50 x 40, 10 x 100 and 2 x 1000 byte requests
+static void profile_workload(pool_profile_t* profile) {
+	size_t sizes[] = {24, 40, 100, 1000};
+	size_t peaks[] = {100, 50, 10, 2};
+	size_t next = 0; 
+
+	pool_profile_reset(profile);
+	for(size_t i = 0; i < 4; i++) {
+		for(size_t j = 0; j < peaks[i]; j++) {
+			pool_profile_malloc(profile, profile_ptr(next++), sizes[i]);
+		}
+	}
+}
+
+bool test_profile_record(void) {
+	bool pass = true; 
+	pool_profile_t* profile = &test_profile;
+	size_t k = size_class_of(24);
+
+	pool_profile_reset(profile);
+	for(size_t i = 0; i < 3; i++) {
+		pool_profile_malloc(profile, profile_ptr(i), 24);
+	}
+	pool_profile_free(profile, profile_ptr(1));
+	pool_profile_malloc(profile, profile_ptr(1), 22);
+	pool_profile_free(profile, profile_ptr(99)); // Never recorded
+	pool_profile_malloc(profile, NULL, 5000); // Failed
+
+	if((profile->requests[k] != 4) || (profile->bytes[k] != 94) || (profile->live[k] != 3) ||
+	   (profile->peak_live[k] != 3) || (profile->requests[size_class_of(5000)] != 1) ||
+	   (profile->live[size_class_of(5000)] != 0)) {
+		pass = false; 
+	}
+
+	// Colliding blocks are all found again when freed
+	pool_profile_reset(profile);
+	for(size_t i = 0; i < 4096; i++) {
+		pool_profile_malloc(profile, profile_ptr(i * 64), 8);
+	}
+	for(size_t i = 0; i < 4096; i++) {
+		pool_profile_free(profile, profile_ptr(i * 64));
+	}
+	if(profile->tracked || profile->live[size_class_of(8)] || (profile->peak_live[size_class_of(8)] != 4096)) {
+		pass = false; 
+	}
+
+	// The event hook sees what the pools hand out
+	pool_deinit(); // Zero global static heap object
+	size_t block_sizes[] = {16, 48, 80, 112};
+	pass &= pool_init(block_sizes, 4);
+
+	pool_profile_reset(profile);
+	pool_set_event_hook(pool_profile_hook, profile);
+	void* ptr1 = pool_malloc(40);
+	void* ptr2 = pool_malloc(40);
+	pool_free(ptr1);
+	pool_set_event_hook(NULL, NULL);
+	pool_free(ptr2);
+
+	size_t expected = (POOL_TRACE_LEVEL >= 2) ? 2 : 0;
+	if((profile->requests[size_class_of(40)] != expected) || (profile->peak_live[size_class_of(40)] != expected)) {
+		pass = false; 
+	}
+
+	return pass; 
+}
+
+bool test_profile_save_load(void) {
+	bool pass = true; 
+	static pool_profile_t loaded; 
+
+	profile_workload(&test_profile);
+	FILE* file = tmpfile();
+	pass &= (file != NULL) && pool_profile_save(&test_profile, file);
+	rewind(file);
+	pass &= pool_profile_load(&loaded, file);
+	fclose(file);
+
+	for(size_t k = 0; k < SIZE_CLASS_COUNT; k++) {
+		if((loaded.requests[k] != test_profile.requests[k]) || (loaded.bytes[k] != test_profile.bytes[k]) ||
+		   (loaded.peak_live[k] != test_profile.peak_live[k]) || loaded.live[k]) {
+			pass = false; 
+		}
+	}
+
+	// Sizes that are not class sizes are rejected
+	file = tmpfile();
+	fputs("pool_profile 1\nuntracked 0\n50 1 50 1\n", file);
+	rewind(file);
+	pass &= !pool_profile_load(&loaded, file);
+	fclose(file);
+
+	return pass; 
+}
+
+bool test_tune_fit(void) {
+	bool pass = true; 
+	pool_tuning_t tuning; 
+
+	profile_workload(&test_profile);
+	pass &= pool_tune(&test_profile, HEAP_SIZE, 0, &tuning);
+
+	// One pool per class, holding its peak with the spare heap shared out
+	size_t expected_sizes[] = {24, 40, 112, 1024};
+	size_t peaks[] = {100, 50, 10, 2};
+	size_t requests[] = {24, 40, 100, 1000};
+	if((tuning.count != 4) || tuning.shortfall || tuning.unfit || (tuning.waste != 10 * 12 + 2 * 24) ||
+	   (tuning.heap_used > HEAP_SIZE)) {
+		return false; 
+	}
+	for(size_t i = 0; i < 4; i++) {
+		if((tuning.block_sizes[i] != expected_sizes[i]) || (tuning.block_counts[i] < peaks[i])) {
+			pass = false; 
+		}
+	}
+
+	// The peak of every class fits at once
+	pool_config_t config = {0};
+	config.block_sizes = tuning.block_sizes;
+	config.block_size_count = tuning.count;
+	config.pool_block_counts = tuning.block_counts;
+	config.spill = POOL_SPILL_NONE;
+	pass &= pool_init_ex(&config);
+
+	for(size_t i = 0; i < 4; i++) {
+		for(size_t j = 0; j < peaks[i]; j++) {
+			void* ptr = pool_malloc(requests[i]);
+			if(!ptr || (pool_usable_size(ptr) != expected_sizes[i])) {
+				pass = false; 
+			}
+		}
+	}
+
+	return pass; 
+}
+
+bool test_tune_budget(void) {
+	bool pass = true; 
+	pool_tuning_t tuning; 
+
+	// A heap too small for the peaks still gets a valid configuration
+	profile_workload(&test_profile);
+	pass &= pool_tune(&test_profile, 4096, 0, &tuning);
+	pass &= (tuning.count == 4) && (tuning.shortfall > 0) && (tuning.heap_used <= 4096);
+
+	pool_config_t config = {0};
+	config.block_sizes = tuning.block_sizes;
+	config.block_size_count = tuning.count;
+	config.pool_block_counts = tuning.block_counts;
+	pass &= verify_pool_config(4096, &config);
+
+	// Sizes under the alignment merge into its multiples, and requests
+	// larger than the heap are left out
+	pool_profile_reset(&test_profile);
+	pool_profile_malloc(&test_profile, profile_ptr(0), 20);
+	pool_profile_malloc(&test_profile, profile_ptr(1), 32);
+	pool_profile_malloc(&test_profile, profile_ptr(2), 8192);
+	pass &= pool_tune(&test_profile, 4096, 16, &tuning);
+	pass &= (tuning.count == 1) && (tuning.block_sizes[0] == 32) && (tuning.block_counts[0] >= 2) &&
+	        (tuning.unfit == 1);
+
+	// Nothing to tune for
+	pool_profile_reset(&test_profile);
+	pass &= !pool_tune(&test_profile, 4096, 0, &tuning);
+
+	return pass; 
+}
+
+bool test_tune_merge_decision(void) {
+	bool pass = true; 
+	pool_tuning_t tuning; 
+
+	// Many small classes, as of an interpreter, and a few huge blocks
+	size_t next = 0;
+	pool_profile_reset(&test_profile);
+	for(size_t k = size_class_of(16); size_class_size(k) <= 1024; k++) {
+		size_t size = size_class_size(k);
+		size_t peak = (size <= 128) ? 24 : ((size <= 512) ? 8 : 2);
+		for(size_t j = 0; j < peak; j++) {
+			pool_profile_malloc(&test_profile, profile_ptr(next++), size);
+		}
+	}
+	pool_profile_malloc(&test_profile, profile_ptr(next++), 49152);
+	pool_profile_malloc(&test_profile, profile_ptr(next++), 20000);
+	pass &= pool_tune(&test_profile, HEAP_SIZE, 0, &tuning);
+
+	// The huge blocks are left out rather than given pools, and the
+	// small classes are split instead of sharing one large block
+	pass &= (tuning.unfit == 2) && (tuning.count == 16) && !tuning.shortfall;
+	pass &= (tuning.block_sizes[0] <= 20) && (tuning.block_sizes[15] == 1024);
+	pass &= (tuning.heap_used <= HEAP_SIZE) && (tuning.waste < 44480 / 8);
+
+	pool_config_t config = {0};
+	config.block_sizes = tuning.block_sizes;
+	config.block_size_count = tuning.count;
+	config.pool_block_counts = tuning.block_counts;
+	pass &= verify_pool_config(HEAP_SIZE, &config);
+
+	return pass; 
+}
+
+/* END Profile and Tuning Tests */
+
+
+/* BEGIN Rebalancing Tests */
+
+// One block per pool in the heap, the rest comes from 1024 byte slabs
+static pool_allocator_t* rebalance_create(uint8_t* buffer, size_t size, size_t reserve_slabs,
+                                          pool_rebalance_t rebalance) {
+	static const size_t block_sizes[] = {16, 256};
+	static const size_t counts[] = {1, 1};
+	pool_config_t config = {
+		.block_sizes = block_sizes,
+		.block_size_count = 2,
+		.pool_block_counts = counts,
+		.spill = POOL_SPILL_NONE,
+		.slab_size = 1024,
+		.reserve_size = reserve_slabs * 1024,
+		.rebalance = rebalance
+	};
+	return pool_create_ex(buffer, size, &config);
+}
+
+bool test_rebalance_inputs(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {16, 1024};
+	pool_config_t config = {
+		.block_sizes = block_sizes,
+		.block_size_count = 2,
+		.slab_size = 1024,
+		.reserve_size = 4096,
+		.rebalance = POOL_REBALANCE_EAGER
+	};
+	pass &= (verify_pool_config(HEAP_SIZE, &config) == !POOL_LOCK_FREE);
+
+	// Whole slabs of whole cache lines, up to POOL_MAX_SLABS of them
+	config.reserve_size = 4000;
+	pass &= !verify_pool_config(HEAP_SIZE, &config);
+	config.reserve_size = 1024 * (POOL_MAX_SLABS + 1);
+	pass &= !verify_pool_config(HEAP_SIZE, &config);
+	config.slab_size = 1040;
+	config.reserve_size = 4160;
+	pass &= !verify_pool_config(HEAP_SIZE, &config);
+
+	// The reserve is the only slab source, and leaves room for the pools
+	config.slab_size = 1024;
+	config.reserve_size = 4096;
+	config.slab_acquire = pool_slab_acquire_mmap;
+	config.slab_release = pool_slab_release_mmap;
+	pass &= !verify_pool_config(HEAP_SIZE, &config);
+	config.slab_acquire = NULL;
+	config.slab_release = NULL;
+	pass &= !verify_pool_config(4096, &config);
+
+	config.rebalance = (pool_rebalance_t)3;
+	pass &= !verify_pool_config(HEAP_SIZE, &config);
+
+	return pass; 
+}
+
+bool test_rebalance_reassign(void) {
+	bool pass = true; 
+
+	POOL_ALIGNAS(POOL_CACHE_LINE) static uint8_t buffer[16384];
+	pool_allocator_t* pool = rebalance_create(buffer, sizeof(buffer), 4, POOL_REBALANCE_EAGER);
+	if(!pool) {
+		return POOL_LOCK_FREE;
+	}
+
+	// The 16 byte class takes the whole reserve
+	static void* ptrs[1 + 4 * 64];
+	for(size_t i = 0; i < 1 + 4 * 64; i++) {
+		ptrs[i] = pool_malloc_from(pool, 16);
+		pass &= (ptrs[i] != NULL);
+	}
+	uint8_t* reserve = pool->heap + pool->reserve_begin;
+	if(((uint8_t*)ptrs[1] < reserve) || (pool_usable_size_from(pool, ptrs[1]) != 16) ||
+	   (pool->pool_slabs[0] != 0xF) || pool->reserve_free) {
+		pass = false; 
+	}
+
+	// So the 256 byte class cannot grow
+	void* big = pool_malloc_from(pool, 256);
+	if(!big || pool_malloc_from(pool, 256)) {
+		pass = false; 
+	}
+
+	// Until the slabs are emptied and handed over
+	for(size_t i = 0; i < 1 + 4 * 64; i++) {
+		pool_free_to(pool, ptrs[i]);
+	}
+	pool_stats_t stats;
+	pool_get_stats_from(pool, &stats);
+	if((pool->reserve_free != 0xF) || pool->slab_used || (stats.reserve_free != 4)) {
+		pass = false; 
+	}
+	for(size_t i = 0; i < 4 * 4; i++) {
+		ptrs[i] = pool_malloc_from(pool, 256);
+		if(((uint8_t*)ptrs[i] < reserve) || ((uint8_t*)ptrs[i] >= pool->heap + pool->heap_size)) {
+			pass = false; 
+		}
+	}
+	if((pool->pool_slabs[1] != 0xF) || pool_malloc_from(pool, 256)) {
+		pass = false; 
+	}
+
+	pool_destroy(pool);
+	return pass; 
+}
+
+bool test_rebalance_policies(void) {
+	bool pass = true; 
+
+	POOL_ALIGNAS(POOL_CACHE_LINE) static uint8_t buffer[16384];
+	static void* ptrs[1 + 64 + 1];
+
+	// Emptied slabs stay until trimmed
+	pool_allocator_t* pool = rebalance_create(buffer, sizeof(buffer), 2, POOL_REBALANCE_TRIM);
+	if(!pool) {
+		return POOL_LOCK_FREE;
+	}
+	ptrs[0] = pool_malloc_from(pool, 16);
+	ptrs[1] = pool_malloc_from(pool, 16);
+	pool_free_to(pool, ptrs[1]);
+	if((pool->slab_used != 0x1) || (pool->reserve_free != 0x2)) {
+		pass = false; 
+	}
+	if((pool_trim(pool) != 1) || (pool->reserve_free != 0x3)) {
+		pass = false; 
+	}
+	pool_destroy(pool);
+
+	// A spare slab goes back while another one has free blocks
+	pool = rebalance_create(buffer, sizeof(buffer), 2, POOL_REBALANCE_SPARE);
+	for(size_t i = 0; i < 1 + 64 + 1; i++) {
+		ptrs[i] = pool_malloc_from(pool, 16);
+	}
+	for(size_t i = 1; i < 1 + 64; i++) {
+		pool_free_to(pool, ptrs[i]);
+	}
+	if((__builtin_popcount(pool->slab_used) != 1) || (pool->reserve_free != 0x1)) {
+		pass = false; 
+	}
+
+	// But the last one is kept
+	pool_free_to(pool, ptrs[1 + 64]);
+	if((__builtin_popcount(pool->slab_used) != 1) || (pool_trim(pool) != 1) || (pool->reserve_free != 0x3)) {
+		pass = false; 
+	}
+	pool_destroy(pool);
+
+	return pass; 
+}
+
+bool test_rebalance_bulk(void) {
+	bool pass = true; 
+
+	POOL_ALIGNAS(POOL_CACHE_LINE) static uint8_t buffer[16384];
+	pool_allocator_t* pool = rebalance_create(buffer, sizeof(buffer), 1, POOL_REBALANCE_EAGER);
+	if(!pool) {
+		return POOL_LOCK_FREE;
+	}
+
+	// Reserve blocks move between classes like any other
+	void* ptrs[8];
+	for(size_t i = 0; i < 8; i++) {
+		ptrs[i] = pool_malloc_from(pool, 16);
+	}
+	void* moved = pool_realloc_from(pool, ptrs[7], 200);
+	if(!moved || (pool_usable_size_from(pool, moved) != 256)) {
+		pass = false; 
+	}
+	pool_free_to(pool, moved);
+
+	// Freeing in bulk empties the slab too
+	pool_free_bulk_to(pool, ptrs, 7);
+	if(pool->slab_used || (pool->reserve_free != 0x1)) {
+		pass = false; 
+	}
+
+	pool_destroy(pool);
+	return pass; 
+}
+
+/* END Rebalancing Tests */
+
+
+/* BEGIN Bitmap Tracking Tests */
+
+static bool bitmap_init(const size_t* block_sizes, size_t block_size_count) {
+	pool_config_t config = {
+		.block_sizes = block_sizes,
+		.block_size_count = block_size_count,
+		.spill = POOL_SPILL_NONE,
+		.bitmap = true
+	};
+	return pool_init_ex(&config);
+}
+
+bool test_bitmap_inputs(void) {
+	bool pass = true; 
+
+	// Blocks no longer hold links, so 1 byte classes are valid
+	size_t block_sizes[] = {1, 3, 8, 64};
+	pool_config_t config = {
+		.block_sizes = block_sizes,
+		.block_size_count = 4,
+		.bitmap = true
+	};
+	pass &= (verify_pool_config(HEAP_SIZE, &config) == !POOL_LOCK_FREE);
+	config.bitmap = false;
+	pass &= !verify_pool_config(HEAP_SIZE, &config);
+
+	// Not with growth slabs
+	config.bitmap = true;
+	config.slab_size = 1024;
+	config.reserve_size = 4096;
+	pass &= !verify_pool_config(HEAP_SIZE, &config);
+
+	// The bitmaps take room from the pools
+	size_t tiny[] = {1};
+	pool_config_t exact = {
+		.block_sizes = tiny,
+		.block_size_count = 1,
+		.pool_block_counts = (size_t[]){HEAP_SIZE},
+		.bitmap = true
+	};
+	pass &= !verify_pool_config(HEAP_SIZE, &exact);
+
+	return pass; 
+}
+
+bool test_bitmap_address_order(void) {
+	bool pass = true; 
+
+	pool_deinit(); // Zero global static heap object
+	size_t block_sizes[] = {1, 2, 4, 8};
+	if(!bitmap_init(block_sizes, 4)) {
+		return POOL_LOCK_FREE;
+	}
+
+	uint8_t* ptr1 = pool_malloc(1);
+	uint8_t* ptr2 = pool_malloc(1);
+	uint8_t* ptr3 = pool_malloc(1);
+	pass &= ptr1 && ptr2 && ptr3 && (pool_usable_size(ptr1) == 1);
+#if !POOL_THREAD_SAFE
+	// Lowest free block first, thread caches hand out the latest instead
+	pass &= (ptr1 == g_pool_heap) && (ptr2 == ptr1 + 1) && (ptr3 == ptr2 + 1);
+#endif
+
+	// Freed blocks keep their contents, and are reused
+	*ptr2 = 0x5A;
+	pool_free(ptr2);
+	if((*ptr2 != 0x5A) || (pool_malloc(1) != ptr2)) {
+		pass = false; 
+	}
+
+	// A pool fills up and frees up like any other
+	size_t count = 3;
+	while(pool_malloc(1)) {
+		count++;
+	}
+	pool_free(ptr1);
+	pass &= (count == (size_t)pool_controller.pool_end_indices[0] + 1) && (pool_malloc(1) == ptr1);
+
+	return pass; 
+}
+
+bool test_bitmap_double_free(void) {
+	bool pass = true; 
+
+	pool_deinit(); // Zero global static heap object
+	size_t block_sizes[] = {16, 64};
+	if(!bitmap_init(block_sizes, 2)) {
+		return POOL_LOCK_FREE;
+	}
+
+	uint8_t* ptr = pool_malloc(16);
+	pool_free(ptr);
+	pool_free(ptr);
+	pool_thread_cache_flush();
+
+	pool_stats_t stats;
+	pool_get_stats(&stats);
+	pass &= (stats.double_frees == 1);
+
+	// The block was only freed once
+	uint8_t* ptr1 = pool_malloc(16);
+	uint8_t* ptr2 = pool_malloc(16);
+	pass &= (ptr1 != ptr2);
+
+	return pass; 
+}
+
+static void bitmap_collect(void* block, size_t block_size, void* ctx) {
+	uint8_t** blocks = ctx;
+	while(*blocks) {
+		blocks++;
+	}
+	*blocks = block;
+	(void)block_size;
+}
+
+bool test_bitmap_visit_live(void) {
+	bool pass = true; 
+
+	pool_deinit(); // Zero global static heap object
+	size_t block_sizes[] = {1, 2, 4, 8};
+	if(!bitmap_init(block_sizes, 4)) {
+		return POOL_LOCK_FREE;
+	}
+
+	uint8_t* ptrs[200];
+	for(size_t i = 0; i < 200; i++) {
+		ptrs[i] = pool_malloc((i % 2) ? 8 : 1);
+	}
+	for(size_t i = 0; i < 200; i += 4) {
+		pool_free(ptrs[i]);
+	}
+	pool_thread_cache_flush();
+
+	// Every block still held, in address order
+	static uint8_t* visited[201];
+	memset(visited, 0, sizeof(visited));
+	pass &= (pool_visit_live(bitmap_collect, visited) == 150);
+	for(size_t i = 1; i < 150; i++) {
+		pass &= (visited[i - 1] < visited[i]);
+	}
+	for(size_t i = 0; i < 200; i++) {
+		bool found = false;
+		for(size_t j = 0; j < 150; j++) {
+			found |= (visited[j] == ptrs[i]);
+		}
+		pass &= (found == ((i % 4) != 0));
+	}
+
+	// Instances without bitmaps have nothing to visit
+	size_t linked_sizes[] = {8, 64};
+	pass &= pool_init(linked_sizes, 2);
+	pass &= !pool_visit_live(bitmap_collect, visited);
+
+	return pass; 
+}
+
+/* END Bitmap Tracking Tests */
+
+/* BEGIN NUMA Arena Tests */
+#define NUMA_HEAP_SIZE	32768
+
+static bool numa_in_arena(const void* ptr, size_t node) {
+	pool_allocator_t* arena = pool_numa_arena(node);
+	return arena && ((const uint8_t*)ptr >= arena->heap) &&
+	       ((const uint8_t*)ptr < arena->heap + arena->heap_size);
+}
+
+bool test_numa_inputs(void) {
+	bool pass = true; 
+
+	pool_deinit(); // Zero global static heap object
+	size_t block_sizes[] = {16, 64};
+	pass &= pool_init(block_sizes, 2);
+	pool_config_t config = {.block_sizes = block_sizes, .block_size_count = 2};
+
+	// Growth slabs, too many nodes and unmappable heaps
+	pool_config_t growth = config;
+	growth.slab_acquire = pool_slab_acquire_mmap;
+	growth.slab_release = pool_slab_release_mmap;
+	growth.slab_size = 4096;
+	pass &= !pool_numa_init(&growth, NUMA_HEAP_SIZE, 2);
+	pass &= !pool_numa_init(&config, NUMA_HEAP_SIZE, POOL_NUMA_MAX_NODES + 1);
+	pass &= !pool_numa_init(&config, 8, 2);
+	pass &= !pool_numa_node_count();
+
+	// One arena per simulated node, pages left to first touch
+	pass &= pool_numa_init(&config, NUMA_HEAP_SIZE, 3);
+	pass &= (pool_numa_node_count() == 3);
+	pass &= pool_numa_arena(0) && pool_numa_arena(1) && pool_numa_arena(2);
+	pass &= (pool_numa_arena(0) != pool_numa_arena(1));
+	pass &= !pool_numa_arena(3);
+	pass &= (pool_numa_node() < 3);
+	pass &= (pool_numa_arena(0)->pool_bumps[1] == pool_numa_arena(0)->pool_begin_indices[1]);
+
+	// Without arenas the global heap serves again
+	pool_numa_deinit();
+	pass &= !pool_numa_node_count() && !pool_numa_arena(0);
+	uint8_t* ptr = pool_malloc(16);
+	pass &= (ptr == g_pool_heap);
+	pool_free(ptr);
+
+#if POOL_THREAD_SAFE || POOL_LOCK_FREE
+	// A worker that flushed may exit after the arenas are gone
+	pthread_barrier_t barrier;
+	pthread_barrier_init(&barrier, NULL, 2);
+	cache_worker_t worker = {NULL, &barrier, true};
+	pass &= pool_numa_init(&config, NUMA_HEAP_SIZE, 2);
+	pthread_t thread;
+	pthread_create(&thread, NULL, cache_worker, &worker);
+	pthread_barrier_wait(&barrier);
+	pool_numa_deinit();
+	pthread_barrier_wait(&barrier);
+	pthread_join(thread, NULL);
+	pthread_barrier_destroy(&barrier);
+#endif
+
+	return pass; 
+}
+
+bool test_numa_local_allocation(void) {
+	bool pass = true; 
+
+	size_t block_sizes[] = {16, 64};
+	pool_config_t config = {.block_sizes = block_sizes, .block_size_count = 2};
+	if(!pool_numa_init(&config, NUMA_HEAP_SIZE, 2)) {
+		return false;
+	}
+
+	// Each allocation comes from the arena of the thread's node
+	for(int node = 0; node < 4; node++) {
+		pool_numa_bind_thread(node);
+		pass &= (pool_numa_node() == (size_t)node % 2);
+
+		void* ptr = pool_malloc(16);
+		void* aligned = pool_aligned_malloc(64, 64);
+		void* bulk[4];
+		pass &= (pool_malloc_bulk(64, 4, bulk) == 4);
+		pass &= numa_in_arena(ptr, node % 2) && numa_in_arena(aligned, node % 2);
+		for(size_t i = 0; i < 4; i++) {
+			pass &= numa_in_arena(bulk[i], node % 2);
+		}
+
+		pool_free(ptr);
+		pool_free(aligned);
+		pool_free_bulk(bulk, 4);
+	}
+
+	// Unbound threads follow the CPU they run on
+	pool_numa_bind_thread(-1);
+	size_t node = pool_numa_node();
+	void* ptr = pool_malloc(16);
+	pass &= (node < 2) && numa_in_arena(ptr, node);
+	pool_free(ptr);
+
+	pool_numa_deinit();
+	return pass; 
+}
+
+bool test_numa_home_free(void) {
+	bool pass = true; 
+
+	pool_deinit(); // Zero global static heap object
+	size_t block_sizes[] = {16, 64};
+	pass &= pool_init(block_sizes, 2);
+	uint8_t* global = pool_malloc(16);
+
+	pool_config_t config = {.block_sizes = block_sizes, .block_size_count = 2};
+	if(!pool_numa_init(&config, NUMA_HEAP_SIZE, 2)) {
+		return false;
+	}
+
+	pool_numa_bind_thread(0);
+	void* ptrs[6];
+	for(size_t i = 0; i < 6; i++) {
+		ptrs[i] = pool_malloc(16);
+	}
+	uint8_t* grown = pool_malloc(16);
+	memset(grown, 0xAA, 16);
+
+	// Freed from node 1, every block goes back to node 0
+	pool_numa_bind_thread(1);
+	pass &= (pool_usable_size(ptrs[0]) == 16);
+	pool_free(ptrs[0]);
+	pool_free_sized(ptrs[1], 16);
+	pool_free_bulk(&ptrs[2], 4);
+	grown = pool_realloc(grown, 64);
+	pass &= numa_in_arena(grown, 0) && (grown[15] == 0xAA);
+	pool_free(grown);
+	pool_free(global);
+	pool_thread_cache_flush();
+
+	pool_stats_t stats;
+	pool_get_stats_from(pool_numa_arena(0), &stats);
+	pass &= !stats.pools[0].in_use && !stats.pools[1].in_use;
+	pass &= (stats.pools[0].frees == 7) && (stats.pools[1].frees == 1);
+	pool_get_stats_from(pool_numa_arena(1), &stats);
+	pass &= !stats.pools[0].allocs && !stats.pools[0].frees;
+	pool_get_stats(&stats);
+	pass &= !stats.pools[0].in_use && (stats.pools[0].frees == 1);
+
+	pool_numa_bind_thread(-1);
+	pool_numa_deinit();
+	return pass; 
+}
+
+bool test_numa_online_nodes(void) {
+	bool pass = true; 
+
+	// Sparse and ranged node lists give the IDs themselves
+	unsigned nodes[POOL_NUMA_MAX_NODES];
+	pass &= (pool_numa_parse_nodes("0,2\n", nodes, POOL_NUMA_MAX_NODES) == 2);
+	pass &= (nodes[0] == 0) && (nodes[1] == 2);
+	pass &= (pool_numa_parse_nodes("0-1,4-5", nodes, POOL_NUMA_MAX_NODES) == 4);
+	pass &= (nodes[0] == 0) && (nodes[1] == 1) && (nodes[2] == 4) && (nodes[3] == 5);
+	pass &= (pool_numa_parse_nodes("0-7", nodes, 3) == 3) && (nodes[2] == 2);
+	pass &= (pool_numa_parse_nodes("3-1", nodes, POOL_NUMA_MAX_NODES) == 0);
+	pass &= (pool_numa_parse_nodes("", nodes, POOL_NUMA_MAX_NODES) == 0);
+
+	// Bound mappings work whether or not the kernel supports NUMA
+	size_t block_sizes[] = {16, 64};
+	pool_config_t config = {.block_sizes = block_sizes, .block_size_count = 2};
+	pool_allocator_t* pool = pool_map(NUMA_HEAP_SIZE, &config, POOL_MAP_NODE(0));
+	if(!pool) {
+		return false;
+	}
+	uint8_t* ptr = pool_malloc_from(pool, 64);
+	memset(ptr, 0xAA, 64);
+	pool_free_to(pool, ptr);
+	pool_destroy(pool);
+
+	// One arena per online node, serving the node the thread runs on
+	pass &= pool_numa_init(&config, NUMA_HEAP_SIZE, 0);
+	size_t count = pool_numa_node_count();
+	pass &= (count >= 1) && (count <= POOL_NUMA_MAX_NODES);
+	size_t node = pool_numa_node();
+	ptr = pool_malloc(64);
+	pass &= (node < count) && numa_in_arena(ptr, node);
+	memset(ptr, 0xAA, 64);
+	pool_free(ptr);
+
+	pool_numa_deinit();
+	return pass; 
+}
+
+/* END NUMA Arena Tests */
\ No newline at end of file
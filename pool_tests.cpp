@@ -0,0 +1,200 @@
+#include <cassert>
+#include <cstdio>
+#include <unordered_map>
+#include <vector>
+
+#include "pool_alloc.hpp"
+
+using namespace pool_alloc;
+
+/* C++ INTERFACE TESTS
+ *
+ * Built against pool_alloc.c compiled with POOL_LIBRARY, see the cxx
+ * target of the Makefile.
+*/
+
+using SmallPool = TunablePool<8, 32, 128, 512>;
+
+struct alignas(128) OverAligned {
+	uint8_t bytes[128];
+};
+
+// Block size of the pool owning ptr, 0 outside the heap
+static size_t block_size_of(const pool_allocator_t* pool, const void* ptr) {
+	for(size_t i = 0; i < pool->num_pools; i++) {
+		const uint8_t* begin = &pool->heap[pool->pool_begin_indices[i]];
+		const uint8_t* end = &pool->heap[pool->pool_end_indices[i]] + pool->block_sizes[i];
+		if((ptr >= begin) && (ptr < end)) {
+			return pool->block_sizes[i];
+		}
+	}
+	return 0;
+}
+
+// Size classes and pools resolved at compile time
+static_assert(size_class(1) == 0);
+static_assert(size_class(8) == 7);
+static_assert(size_class(9) == 8);
+static_assert(size_class(48) == size_class(41));
+static_assert(is_class_size(48) && !is_class_size(50));
+static_assert(SmallPool::pool_of(8) == 0);
+static_assert(SmallPool::pool_of(33) == 2);
+static_assert(SmallPool::pool_of(513) == SmallPool::count);
+
+// Blocks aligned for T by their size class skip the aligned path
+static_assert(class_aligned<int>(32) && class_aligned<double>(64));
+static_assert(!class_aligned<int>(4) && !class_aligned<int>(12));
+static_assert(!class_aligned<OverAligned>(1024));
+static_assert(SmallPool::block_alignment(8) == 8);
+static_assert(TunablePool<12, 16>::block_alignment(12) == 4);
+
+
+// Compile-time sized blocks come from the best fitting pool
+bool test_cxx_tunable_class(void) {
+	alignas(POOL_CACHE_LINE) static uint8_t buffer[16384];
+	SmallPool pool(buffer, sizeof(buffer));
+	if(!pool) {
+		return false;
+	}
+
+	void* a = pool.allocate<24>();
+	void* b = pool.allocate<100>();
+	bool placed = a && b && (block_size_of(pool.get(), a) == 32) && (block_size_of(pool.get(), b) == 128);
+
+	pool.deallocate<24>(a);
+	pool.deallocate<100>(b);
+	return placed && (pool.allocate<24>() == a);
+}
+
+// Objects are constructed in and released to their size class
+bool test_cxx_tunable_create(void) {
+	alignas(POOL_CACHE_LINE) static uint8_t buffer[16384];
+	SmallPool pool(buffer, sizeof(buffer));
+
+	struct Point {
+		int x, y;
+		Point(int x, int y) : x(x), y(y) {}
+	};
+
+	Point* p = pool.create<Point>(3, 4);
+	bool built = p && (p->x == 3) && (p->y == 4) && (block_size_of(pool.get(), p) == 8);
+	pool.destroy(p);
+	return built && (pool.create<Point>(5, 6) == p);
+}
+
+// Exhaustion without spilling surfaces as nullptr
+bool test_cxx_tunable_exhaustion(void) {
+	alignas(POOL_CACHE_LINE) static uint8_t buffer[16384];
+	SmallPool pool(buffer, sizeof(buffer), POOL_SPILL_NONE);
+
+	size_t count = 0;
+	while(pool.allocate<512>()) {
+		count++;
+	}
+	return (count > 0) && !pool.allocate<512>() && pool.allocate<128>();
+}
+
+// Containers allocate their nodes and arrays from the instance
+bool test_cxx_allocator_containers(void) {
+	alignas(POOL_CACHE_LINE) static uint8_t buffer[65536];
+	TunablePool<16, 64, 256, 1024> pool(buffer, sizeof(buffer));
+
+	std::vector<int, PoolAllocator<int>> vec{PoolAllocator<int>(pool)};
+	for(int i = 0; i < 100; i++) {
+		vec.push_back(i);
+	}
+
+	using Map = std::unordered_map<int, int, std::hash<int>, std::equal_to<int>,
+	                               PoolAllocator<std::pair<const int, int>>>;
+	Map map{16, std::hash<int>(), std::equal_to<int>(), PoolAllocator<std::pair<const int, int>>(pool)};
+	for(int i = 0; i < 50; i++) {
+		map[i] = i * i;
+	}
+
+	bool owned = (block_size_of(pool.get(), vec.data()) == 1024);
+	for(int i = 0; i < 100; i++) {
+		owned = owned && (vec[i] == i);
+	}
+	for(int i = 0; i < 50; i++) {
+		owned = owned && (map.at(i) == i * i);
+	}
+	return owned && (map.get_allocator() == PoolAllocator<int>(pool));
+}
+
+// Exhaustion surfaces as std::bad_alloc
+bool test_cxx_allocator_bad_alloc(void) {
+	alignas(POOL_CACHE_LINE) static uint8_t buffer[16384];
+	SmallPool pool(buffer, sizeof(buffer));
+	PoolAllocator<uint8_t> alloc(pool);
+
+	try {
+		alloc.allocate(1024);
+	}
+	catch(const std::bad_alloc&) {
+		return true;
+	}
+	return false;
+}
+
+// Arrays of aligned types are served by size class where blocks are
+// aligned for them, from the best fitting pool
+bool test_cxx_allocator_class_aligned(void) {
+	alignas(POOL_CACHE_LINE) static uint8_t buffer[65536];
+	TunablePool<16, 64, 256, 1024> pool(buffer, sizeof(buffer));
+	PoolAllocator<int> alloc(pool);
+
+	static_assert(class_aligned<int>(16 * sizeof(int)) && class_aligned<int>(200 * sizeof(int)));
+	int* sixteen = alloc.allocate(16);
+	int* hundreds = alloc.allocate(200);
+	bool placed = (block_size_of(pool.get(), sixteen) == 64) && (block_size_of(pool.get(), hundreds) == 1024);
+
+	// Too small for the class to guarantee int alignment, still aligned
+	int* three = alloc.allocate(3);
+	placed = placed && (block_size_of(pool.get(), three) == 16) && !((uintptr_t)three % alignof(int));
+
+	std::vector<int, PoolAllocator<int>> vec{alloc};
+	vec.reserve(16);
+	placed = placed && (block_size_of(pool.get(), vec.data()) == 64);
+
+	alloc.deallocate(three, 3);
+	alloc.deallocate(hundreds, 200);
+	alloc.deallocate(sixteen, 16);
+	return placed && (alloc.allocate(16) == sixteen);
+}
+
+// Over-aligned types take the aligned path, here on the page aligned
+// global heap
+bool test_cxx_allocator_over_aligned(void) {
+	const size_t block_sizes[] = {8, 64, 256, 1024};
+	if(!pool_init(block_sizes, 4)) {
+		return false;
+	}
+	PoolAllocator<OverAligned> alloc;
+
+	OverAligned* one = alloc.allocate(1);
+	OverAligned* two = alloc.allocate(2);
+	bool aligned = !((uintptr_t)one % alignof(OverAligned)) && !((uintptr_t)two % alignof(OverAligned));
+
+	alloc.deallocate(two, 2);
+	alloc.deallocate(one, 1);
+	return aligned && (alloc.allocate(1) == one);
+}
+
+
+int main(void) {
+	printf("Starting C++ Test Runner\n\n");
+
+	printf("Tests 1-3: TunablePool\n");
+	assert(test_cxx_tunable_class());
+	assert(test_cxx_tunable_create());
+	assert(test_cxx_tunable_exhaustion());
+
+	printf("Tests 4-7: PoolAllocator\n");
+	assert(test_cxx_allocator_containers());
+	assert(test_cxx_allocator_bad_alloc());
+	assert(test_cxx_allocator_over_aligned());
+	assert(test_cxx_allocator_class_aligned());
+
+	printf("\nAll tests passed\n");
+	return 0;
+}
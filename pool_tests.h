@@ -45,6 +45,7 @@ bool test_inputs_large_multiple(void);
 bool test_inputs_mixed_multiple(void);
 bool test_inputs_max_single(void);
 bool test_inputs_exceed_single(void);
+bool test_inputs_unordered_multiple(void);
 
 
 /* Pool Initialization Tests
@@ -81,5 +82,266 @@ bool test_pool_malloc_max_multiple(void);
 */
 bool test_pool_free_single();
 bool test_pool_free_multiple(); 
+bool test_pool_free_owner_lookup(void);
+bool test_pool_free_owner_lookup_non_pow2(void);
+
+
+/* Size Class Lookup Tests
+ *
+ * Naming convention:
+ * test_size_class_<behaviour>()
+*/
+bool test_size_class_boundaries(void);
+bool test_size_class_oversized(void);
+bool test_size_class_spill(void);
+
+
+/* Event Trace Tests
+ *
+ * Naming convention:
+ * test_trace_<behaviour>()
+*/
+void trace_count_hook(const pool_event_t* event, void* ctx);
+bool test_trace_events(void);
+
+
+/* Allocator Instance Tests
+ *
+ * Naming convention:
+ * test_instance_<behaviour>()
+*/
+bool test_instance_separate_heaps(void);
+bool test_instance_invalid_inputs(void);
+bool test_instance_exhaustion_isolated(void);
+
+
+/* Lazy Initialization Tests
+ *
+ * Naming convention:
+ * test_lazy_<behaviour>()
+*/
+bool lazy_init_base(const size_t* block_sizes, size_t block_size_count);
+bool test_lazy_init_untouched(void);
+bool test_lazy_malloc_order(void);
+bool test_lazy_exhaustion(void);
+bool test_lazy_instance_untouched(void);
+
+
+/* Non-Uniform Pool Sizing Tests
+ *
+ * Naming convention:
+ * test_layout_<behaviour>()
+*/
+bool test_layout_weighted(void);
+bool test_layout_counted(void);
+bool test_layout_invalid_config(void);
+
+
+/* Spill Policy Tests
+ *
+ * Naming convention:
+ * test_spill_<policy>()
+*/
+bool spill_init_base(pool_spill_t spill);
+bool test_spill_any(void);
+bool test_spill_next(void);
+bool test_spill_none(void);
+bool test_spill_invalid_policy(void);
+
+
+/* Pool Growth Tests
+ *
+ * Naming convention:
+ * test_growth_<behaviour>()
+*/
+void* growth_acquire_none(size_t size, void* ctx);
+void growth_release_none(void* slab, size_t size, void* ctx);
+bool test_growth_parent_slabs(void);
+bool test_growth_mmap_slab(void);
+bool test_growth_acquire_failure(void);
+bool test_growth_invalid_config(void);
+
+
+/* Mapped Heap Tests
+ *
+ * Naming convention:
+ * test_map_<behaviour>()
+*/
+bool test_map_page_aligned_instance(void);
+bool test_map_heap(void);
+bool test_map_huge_pages(void);
+bool test_map_trim_unused_pools(void);
+
+
+/* Aligned Allocation Tests
+ *
+ * Naming convention:
+ * test_aligned_<behaviour>()
+*/
+bool test_aligned_cache_line_blocks(void);
+bool test_aligned_malloc_pool_choice(void);
+bool test_aligned_malloc_invalid(void);
+bool test_aligned_malloc_unsatisfiable(void);
+
+
+/* Bulk Allocation Tests
+ *
+ * Naming convention:
+ * test_bulk_<behaviour>()
+*/
+bool test_bulk_malloc_order(void);
+bool test_bulk_free_reuse(void);
+bool test_bulk_spill(void);
+bool test_bulk_concurrent(void);
+
+
+/* Sized Free Tests
+ *
+ * Naming convention:
+ * test_sized_free_<behaviour>()
+*/
+bool test_sized_free_reuse(void);
+bool test_sized_free_spilled(void);
+
+
+/* Realloc Tests
+ *
+ * Naming convention:
+ * test_realloc_<behaviour>()
+*/
+bool test_realloc_in_place(void);
+bool test_realloc_migrates(void);
+bool test_realloc_exhausted(void);
+bool test_realloc_usable_size(void);
+
+
+/* Statistics Tests
+ *
+ * Naming convention:
+ * test_stats_<behaviour>()
+*/
+bool test_stats_usage(void);
+bool test_stats_failures(void);
+bool test_stats_slabs(void);
+bool test_stats_dump(void);
+
+
+/* Size Class Tests
+ *
+ * Naming convention:
+ * test_classes_<behaviour>()
+*/
+bool test_classes_inputs(void);
+bool test_classes_fit(void);
+bool test_classes_alignment(void);
+bool test_classes_utilization(void);
+
+
+/* Profile and Tuning Tests
+ *
+ * Naming convention:
+ * test_profile_<behaviour>()
+ * test_tune_<behaviour>()
+*/
+bool test_profile_record(void);
+bool test_profile_save_load(void);
+bool test_tune_fit(void);
+bool test_tune_budget(void);
+bool test_tune_merge_decision(void);
+
+
+/* Rebalancing Tests
+ *
+ * Naming convention:
+ * test_rebalance_<behaviour>()
+*/
+bool test_rebalance_inputs(void);
+bool test_rebalance_reassign(void);
+bool test_rebalance_policies(void);
+bool test_rebalance_bulk(void);
+
+
+/* Bitmap Tracking Tests
+ *
+ * Naming convention:
+ * test_bitmap_<behaviour>()
+*/
+bool test_bitmap_inputs(void);
+bool test_bitmap_address_order(void);
+bool test_bitmap_double_free(void);
+bool test_bitmap_visit_live(void);
+
+
+/* NUMA Arena Tests
+ *
+ * Naming convention:
+ * test_numa_<behaviour>()
+*/
+bool test_numa_inputs(void);
+bool test_numa_local_allocation(void);
+bool test_numa_home_free(void);
+bool test_numa_online_nodes(void);
+
+
+/* Link Width Tests (POOL_LINK_BITS > 16 builds only)
+ *
+ * Naming convention:
+ * test_link_<behaviour>()
+*/
+#if POOL_LINK_BITS > 16
+#include <stdlib.h>
+bool test_link_wide_instance(void);
+#endif
+
+
+#if POOL_THREAD_SAFE || POOL_LOCK_FREE
+#include <pthread.h>
+size_t count_free_blocks(size_t n);
+void* bulk_stress_worker(void* arg);
+
+// Worker allocating from pool (the global API if NULL), then waiting
+// twice on barrier before exiting
+typedef struct {
+	pool_allocator_t* pool;
+	pthread_barrier_t* barrier;
+	bool flush;
+} cache_worker_t;
+void* cache_worker(void* arg);
+#endif
+
+
+#if POOL_DEBUG
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+// Whether fn fails an assertion, run in a child process
+bool debug_aborts(void (*fn)(void));
+#endif
+
+
+/* Thread Cache Tests (POOL_THREAD_SAFE builds only)
+ *
+ * Naming convention:
+ * test_thread_cache_<behaviour>()
+*/
+#if POOL_THREAD_SAFE
+void* thread_cache_exit_worker(void* arg);
+void* thread_cache_stress_worker(void* arg);
+bool test_thread_cache_reuse(void);
+bool test_thread_cache_exit_flush(void);
+bool test_thread_cache_stress(void);
+#endif
+
+
+/* Lock-Free Free List Tests (POOL_LOCK_FREE builds only)
+ *
+ * Naming convention:
+ * test_lock_free_<behaviour>()
+*/
+#if POOL_LOCK_FREE
+void* lock_free_cross_thread_worker(void* arg);
+bool test_lock_free_tagged_head(void);
+bool test_lock_free_cross_thread_free(void);
+#endif
 
 #endif // POOL_TESTS_H
\ No newline at end of file
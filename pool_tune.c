@@ -0,0 +1,79 @@
+#include "pool_alloc.h"
+#include <stdlib.h>
+
+/* Pool Tuner
+ *
+ * Built by the tune target into build/pool_tune.o:
+ *
+ *     build/pool_tune.o <profile> [heap bytes] [align]
+ *
+ * Reads a profile saved by pool_profile_save(), such as one recorded by
+ * the preload library with POOL_PRELOAD_PROFILE, and prints the block
+ * sizes and pool block counts pool_tune() recommends for the heap, as C
+ * arrays and as a POOL_PRELOAD_SIZES value. The heap defaults to
+ * TUNE_DEFAULT_HEAP_SIZE and align to 16, as the preload library needs.
+ *
+ * Built with 32-bit links, so that heaps up to 4 GiB can be tuned and
+ * blocks hold at least 4 bytes. Tuning for a build with 16-bit links
+ * may therefore leave out 2 and 3 byte blocks.
+*/
+#define TUNE_DEFAULT_HEAP_SIZE	16777216
+#define TUNE_DEFAULT_ALIGN		16
+
+static pool_profile_t g_tune_profile;
+
+static void tune_print_list(const char* name, const size_t* values, size_t count)
+{
+	printf("size_t %s[] = {", name);
+	for(size_t i = 0; i < count; i++) {
+		printf("%s%zu", i ? ", " : "", values[i]);
+	}
+	printf("};\n");
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 2) {
+		fprintf(stderr, "usage: %s <profile> [heap bytes] [align]\n", argv[0]);
+		return 2;
+	}
+	size_t heap_size = (argc > 2) ? strtoull(argv[2], NULL, 10) : TUNE_DEFAULT_HEAP_SIZE;
+	size_t align = (argc > 3) ? strtoull(argv[3], NULL, 10) : TUNE_DEFAULT_ALIGN;
+
+	FILE* in = fopen(argv[1], "r");
+	if(!in || !pool_profile_load(&g_tune_profile, in)) {
+		fprintf(stderr, "cannot read profile %s\n", argv[1]);
+		return 1;
+	}
+	fclose(in);
+
+	size_t requests = 0;
+	for(size_t k = 0; k < SIZE_CLASS_COUNT; k++) {
+		requests += g_tune_profile.requests[k];
+	}
+	if(g_tune_profile.untracked) {
+		fprintf(stderr, "warning: %zu of %zu requests were untracked, peaks are underestimated\n",
+		        g_tune_profile.untracked, requests);
+	}
+
+	pool_tuning_t tuning;
+	if(!pool_tune(&g_tune_profile, heap_size, align, &tuning)) {
+		fprintf(stderr, "no configuration fits a %zu byte heap\n", heap_size);
+		return 1;
+	}
+
+	tune_print_list("block_sizes", tuning.block_sizes, tuning.count);
+	tune_print_list("pool_block_counts", tuning.block_counts, tuning.count);
+
+	printf("POOL_PRELOAD_SIZES=");
+	for(size_t i = 0; i < tuning.count; i++) {
+		printf("%s%zu:%zu", i ? "," : "", tuning.block_sizes[i], tuning.block_counts[i]);
+	}
+	printf("\n\n");
+
+	printf("requests:  %zu (%zu left to the system allocator)\n", requests, tuning.unfit);
+	printf("heap_used: %zu of %zu bytes\n", tuning.heap_used, heap_size);
+	printf("shortfall: %zu blocks at peak\n", tuning.shortfall);
+	printf("waste:     %zu bytes at peak\n", tuning.waste);
+	return 0;
+}